@@ -12,10 +12,42 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+#endif
+
+#define VPUT_MAX 64 // segments passed to one writev
+
+#ifdef __linux__
+// same pages mapped twice back to back, so any window is contiguous
+static char *map_ring(size_t size) {
+    int fd = (int)syscall(SYS_memfd_create, "bufio", MFD_CLOEXEC);
+    if (fd < 0) return NULL;
+    char *base = MAP_FAILED;
+    if (!ftruncate(fd, (off_t)size))
+        base = mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED && (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED || mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+        munmap(base, size * 2);
+        base = MAP_FAILED;
+    }
+    close(fd);
+    return base == MAP_FAILED ? NULL : base;
+}
+#endif
 
 void cpr_freebuf(bufio_t *r) {
     if (!r) return;
     cpr_flushbuf(r);
+#ifdef __linux__
+    if (r->ring)
+        munmap(r->in, r->ring * 2);
+#endif
 
 #ifndef _WIN32
     if (r->fd > -1 && isatty(r->fd)) {
@@ -81,8 +113,27 @@ bufio_t *cpr_makebuf(int fd, size_t bufsize) {
 #endif
 
     r->fd = fd;
+    r->state = 0;
     r->bufsize = bufsize;
-    r->start = r->end = 0;
+    r->start = r->end = r->put = r->scan = 0;
+    r->ring = 0;
+    r->in = r->buf;
+    return r;
+}
+
+// falls back to compacting reads if no ring can be mapped
+bufio_t *cpr_ringbuf(int fd, size_t bufsize) {
+    bufio_t *r = cpr_makebuf(fd, bufsize);
+#ifdef __linux__
+    if (!r) return NULL;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t ring = (bufsize + page) & ~(page - 1); // room for the null byte
+    char *in = map_ring(ring);
+    if (in) {
+        r->in = in;
+        r->ring = ring;
+    }
+#endif
     return r;
 }
 
@@ -92,21 +143,40 @@ bool cpr_resetbuf(bufio_t *r, size_t consume) {
         r->start += consume;
     else
         return false;
+    r->scan = 0;
     size_t remains = r->end - r->start;
-    if (r->start > 0 && remains)
-        memmove(r->buf, &r->buf[r->start], remains);
-    r->start = 0;
-    r->end = remains;
+    if (!r->ring) {
+        if (r->start > 0 && remains)
+            memmove(r->buf, &r->buf[r->start], remains);
+        r->start = 0;
+        r->end = remains;
+    }
     if (remains < r->bufsize)
         return cpr_fillbuf(r, r->bufsize - remains);
     else
         return true;
 }
 
+// on a blocking stream this is a socket timeout, not a would block state
+static bool would_block(bufio_t *b, unsigned want) {
+    bool again = errno == EAGAIN || errno == EWOULDBLOCK;
+#ifdef _WIN32
+    if (b->socket) again = WSAGetLastError() == WSAEWOULDBLOCK;
+#endif
+    if (!again) {
+        b->state |= BUFIO_ERROR;
+        return false;
+    }
+    if (!(b->state & BUFIO_NONBLOCK)) return false;
+    b->state |= want;
+    return true;
+}
+
 bool cpr_flushbuf(bufio_t *w) {
     if (!w || !w->put) return false;
     char *out = ((char *)w) + sizeof(bufio_t) + w->bufsize;
     ssize_t result;
+retry:
 #ifdef _WIN32
     if (w->socket) {
         result = send(w->fd, out, w->put, 0);
@@ -115,14 +185,20 @@ bool cpr_flushbuf(bufio_t *w) {
 #endif
     result = write(w->fd, out, w->put); // FlawFinder: ignore
 writer:                                 // NOLINT
+    if (result < 0) {
+        if (errno == EINTR) goto retry;
+        would_block(w, BUFIO_WRITE);
+        return false; // nothing written, output kept
+    }
     if ((size_t)result < w->put) {
         size_t remaining = w->put - (size_t)result;
         memmove(out, out + result, remaining);
         w->put = remaining;
+        w->state |= BUFIO_WRITE;
         return false; // partial flush
     }
-    if (result < w->put) return false;
     w->put = 0;
+    w->state &= ~BUFIO_WRITE;
     return true;
 }
 
@@ -130,7 +206,8 @@ bool cpr_xputbuf(bufio_t *w, const void *data, size_t request) {
     if (!data || !w || request > w->bufsize) return false;
     char *out = ((char *)w) + sizeof(bufio_t) + w->bufsize;
     if (request + w->put > w->bufsize) {
-        if (!cpr_flushbuf(w)) return false;
+        cpr_flushbuf(w); // a partial flush may still make room
+        if (request + w->put > w->bufsize) return false;
     }
     cpr_memcpy(&out[w->put], w->bufsize - w->put, data, request);
     w->put += request;
@@ -145,6 +222,10 @@ bool cpr_sputbuf(bufio_t *w, const char *text) {
 
 bool cpr_fillbuf(bufio_t *r, size_t request) {
     if (!r || request > r->bufsize) return false;
+    if (r->ring && r->start >= r->ring) { // keep the window in the first map
+        r->start -= r->ring;
+        r->end -= r->ring;
+    }
     size_t remains = r->end - r->start;
     size_t avail = r->bufsize - r->start;
     bool refill = false;
@@ -154,32 +235,41 @@ bool cpr_fillbuf(bufio_t *r, size_t request) {
     }
     // if we don't have enough data...
     if (remains < request) { // see if we need to move
-        if (avail < request && r->start < r->end) {
-            memmove(r->buf, &r->buf[r->start], r->end - r->start);
-            r->end -= r->start;
+        if (!r->ring && avail < request) {
+            if (remains)
+                memmove(r->buf, &r->buf[r->start], remains);
+            r->end = remains;
             r->start = 0;
         }
+        size_t space = r->ring ? r->bufsize - remains : r->bufsize - r->end;
         // FlawFinder: read any extra data to complete request
         ssize_t n;
+    retry:
 #ifdef _WIN32
         if (r->socket) {
-            n = recv(r->fd, &r->buf[r->end], r->bufsize - r->end, 0);
+            n = recv(r->fd, &r->in[r->end], space, 0);
             goto reader;
         }
 #endif
-        n = read(r->fd, &r->buf[r->end], r->bufsize - r->end); // FlawFinder: ignore
-    reader:                                                    // NOLINT
+        n = read(r->fd, &r->in[r->end], space); // FlawFinder: ignore
+    reader:                                     // NOLINT
         if (n > 0) {
             r->end += n;
-            r->buf[r->end] = 0;
-            if ((r->end - r->start) < request) return false;
+            r->in[r->end] = 0;
+            r->state &= ~BUFIO_READ;
+            if (!refill && (r->end - r->start) < request) return false;
         } else {
-            r->buf[r->end] = 0;
-            if (n == 0) return false; // always false if eof...
-            return refill;            // for parser can have less than request
+            r->in[r->end] = 0;
+            if (n == 0) {
+                r->state |= BUFIO_EOF;
+                return false; // always false if eof...
+            }
+            if (errno == EINTR) goto retry;
+            would_block(r, BUFIO_READ);
+            return false; // data read so far is kept
         }
     } else
-        r->buf[r->end] = 0; // use null byte, even if full, overflow space
+        r->in[r->end] = 0; // use null byte, even if full, overflow space
     return true;
 }
 
@@ -198,8 +288,9 @@ bool cpr_cputbuf(bufio_t *r, char ch) {
 const void *cpr_xgetbuf(bufio_t *r, size_t request) {
     if (!r || r->bufsize < request) return NULL;
     if (!cpr_fillbuf(r, request)) return NULL;
-    void *out = &r->buf[r->start];
+    void *out = &r->in[r->start];
     r->start += request;
+    r->scan = 0;
     return out;
 }
 
@@ -207,31 +298,118 @@ const char *cpr_lgetbuf(bufio_t *r, size_t *outlen, const char *delim) {
     if (!r) return NULL;
     if (!delim) delim = "\n";
     size_t delim_len = cpr_strlen(delim, 16);
-    size_t scan = r->start;
+    size_t scan = r->start + (r->scan <= r->end - r->start ? r->scan : 0);
     for (;;) {
-        while (scan + delim_len <= r->end) {
-            if (memcmp(&r->buf[scan], delim, delim_len) == 0) {
-                size_t len = scan - r->start;
-                const char *result = &r->buf[r->start];
-                if (outlen) {
-                    *outlen = len;
-                } else {
-                    if (r->start + len < r->bufsize) {
-                        r->buf[r->start + len] = 0;
-                    }
+        const char *found = cpr_memdelim(&r->in[scan], r->end - scan, delim, delim_len);
+        if (found) {
+            scan = (size_t)(found - r->in);
+            size_t len = scan - r->start;
+            const char *result = &r->in[r->start];
+            if (outlen) {
+                *outlen = len;
+            } else {
+                if (r->ring || r->start + len < r->bufsize) {
+                    r->in[r->start + len] = 0;
                 }
-
-                r->start = scan + delim_len;
-                return result;
             }
-            scan++;
+
+            r->start = scan + delim_len;
+            r->scan = 0;
+            r->state &= ~BUFIO_OVERFLOW;
+            return result;
         }
-        if (!cpr_fillbuf(r, 0)) // try in partial mode
+        // resume where a delimiter split by the fill could begin
+        size_t remains = r->end - r->start;
+        if (remains >= r->bufsize) { // a fill could never find it
+            r->state |= BUFIO_OVERFLOW;
             return NULL;
+        }
+        r->scan = remains < delim_len ? 0 : remains - delim_len + 1;
+        if (!cpr_fillbuf(r, 0)) // try in partial mode, kept for the next call
+            return NULL;
+        scan = r->start + r->scan;
     }
 }
 
+// interest for an event loop, read unless at eof and write while pending
+unsigned cpr_wantbuf(const bufio_t *b) {
+    if (!b || (b->state & BUFIO_ERROR)) return 0;
+    unsigned want = b->put ? BUFIO_WRITE : 0;
+    if (!(b->state & BUFIO_EOF)) want |= BUFIO_READ;
+    return want;
+}
+
 #ifndef _WIN32
+// pending output and caller segments go out together, without a copy;
+// returns caller bytes taken, short when non-blocking output would block
+ssize_t cpr_vputbuf(bufio_t *w, const struct iovec *iov, int count) {
+    if (!w || count < 0 || (count && !iov)) return -1;
+    char *out = ((char *)w) + sizeof(bufio_t) + w->bufsize;
+    struct iovec vec[VPUT_MAX];
+    int index = 0;
+    size_t offset = 0; // already sent from iov[index]
+    size_t total = 0;  // caller bytes sent so far
+    for (;;) {
+        while (index < count && offset >= iov[index].iov_len) {
+            ++index;
+            offset = 0;
+        }
+        int used = 0;
+        if (w->put) {
+            vec[used].iov_base = out;
+            vec[used++].iov_len = w->put;
+        }
+        for (int pos = index; pos < count && used < VPUT_MAX; ++pos) {
+            size_t skip = (pos == index) ? offset : 0;
+            if (iov[pos].iov_len <= skip) continue;
+            vec[used].iov_base = (char *)iov[pos].iov_base + skip;
+            vec[used++].iov_len = iov[pos].iov_len - skip;
+        }
+        if (!used) {
+            w->state &= ~BUFIO_WRITE;
+            return (ssize_t)total;
+        }
+        ssize_t result = writev(w->fd, vec, used);
+        if (result < 0 && errno == EINTR) continue;
+        if (result < 0 && would_block(w, BUFIO_WRITE)) return (ssize_t)total;
+        if (result <= 0) return total ? (ssize_t)total : -1;
+        size_t sent = (size_t)result;
+        if (w->put) {
+            if (sent < w->put) {
+                memmove(out, out + sent, w->put - sent);
+                w->put -= sent;
+                continue;
+            }
+            sent -= w->put;
+            w->put = 0;
+        }
+        total += sent;
+        while (sent && index < count) {
+            size_t left = iov[index].iov_len - offset;
+            if (sent < left) {
+                offset += sent;
+                break;
+            }
+            sent -= left;
+            offset = 0;
+            ++index;
+        }
+    }
+}
+
+bool cpr_nonblockbuf(bufio_t *b, bool enable) {
+    if (!b || b->fd < 0) return false;
+    int flags = fcntl(b->fd, F_GETFL);
+    if (flags < 0) return false;
+    flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    if (fcntl(b->fd, F_SETFL, flags) < 0) return false;
+    if (enable)
+        b->state |= BUFIO_NONBLOCK;
+    else
+        b->state &= ~(BUFIO_NONBLOCK | BUFIO_READ);
+    return true;
+}
+
 int cpr_waitbuf(const bufio_t *r, int timeout_ms) {
     if (!r || r->fd < 0) return -1;
     struct pollfd pfd = {
@@ -259,7 +437,8 @@ bool cpr_fmtbuf(bufio_t *w, size_t estimated, const char *fmt, ...) {
     if (!w || !fmt || !estimated || estimated > w->bufsize) return false;
     char *out = (char *)w + sizeof(bufio_t) + w->bufsize;
     if (w->put + estimated > w->bufsize) {
-        if (!cpr_flushbuf(w)) return false;
+        cpr_flushbuf(w);
+        if (w->put + estimated > w->bufsize) return false;
     }
 
     va_list ap;
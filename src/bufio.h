@@ -8,14 +8,25 @@
 
 #ifndef _WIN32
 #include <termios.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+enum {
+    BUFIO_READ = 1,     // last read would block
+    BUFIO_WRITE = 2,    // output still pending
+    BUFIO_EOF = 4,
+    BUFIO_ERROR = 8,
+    BUFIO_NONBLOCK = 16,
+    BUFIO_OVERFLOW = 32 // line longer than the buffer
+};
+
 typedef struct {
     int fd;
+    unsigned state;
 #ifdef _WIN32
     bool socket;
 #else
@@ -25,11 +36,15 @@ typedef struct {
     size_t start;
     size_t end;
     size_t put;
+    size_t scan; // lgetbuf resumes past start, no delimiter before it
+    size_t ring; // size of a double mapped read ring, 0 if compacting
+    char *in;    // read side, buf or the ring
     char buf[2]; // extra byte to zero end of buf in fetch
 } bufio_t;
 
 bufio_t *cpr_sockbuf(int so, size_t bufsize);
 bufio_t *cpr_makebuf(int fd, size_t bufsize);
+bufio_t *cpr_ringbuf(int fd, size_t bufsize);
 const char *cpr_lgetbuf(bufio_t *r, size_t *outlen, const char *delim);
 const void *cpr_xgetbuf(bufio_t *r, size_t request);
 const char cpr_cgetbuf(bufio_t *r);
@@ -41,6 +56,11 @@ bool cpr_xputbuf(bufio_t *w, const void *data, size_t request);
 bool cpr_sputbuf(bufio_t *w, const char *text);
 bool cpr_fmtbuf(bufio_t *w, size_t estimated, const char *fmt, ...);
 int cpr_waitbuf(const bufio_t *r, int timeout_ms);
+unsigned cpr_wantbuf(const bufio_t *b);
+#ifndef _WIN32
+ssize_t cpr_vputbuf(bufio_t *w, const struct iovec *iov, int count);
+bool cpr_nonblockbuf(bufio_t *b, bool enable);
+#endif
 void cpr_freebuf(bufio_t *r);
 
 #ifdef __cplusplus
@@ -84,24 +84,14 @@ const char *cpr_lgetmem(memio_t *mem, size_t *outlen, const char *delim) {
     if (!mem || mem->get >= mem->size) return NULL;
     if (delim == NULL) delim = "\n";
     size_t delim_len = cpr_strlen(delim, 16);
-    while (1) {
-        for (size_t i = mem->get; i + delim_len <= mem->size; ++i) {
-            if (memcmp(&mem->data[i], delim, delim_len) == 0) {
-                const char *result = &mem->data[mem->get];
-                size_t len = i - mem->get;
-                if (outlen) {
-                    *outlen = len;
-                } else {
-                    if (i < mem->size) {
-                        mem->data[i] = 0;
-                    } else {
-                        return NULL;
-                    }
-                }
-                mem->get = i + delim_len;
-                return result;
-            }
-        }
-        return NULL;
-    }
+    const char *found = cpr_memdelim(&mem->data[mem->get], mem->size - mem->get, delim, delim_len);
+    if (!found) return NULL;
+    const char *result = &mem->data[mem->get];
+    size_t len = (size_t)(found - result);
+    if (outlen)
+        *outlen = len;
+    else
+        mem->data[mem->get + len] = 0;
+    mem->get += len + delim_len;
+    return result;
 }
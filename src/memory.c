@@ -2,8 +2,121 @@
 // Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
 
 #include "memory.h"
+#include "thread.h"
+
+#define SHARE_CLASSES 7 // pooled sizes of 128 to 8192 bytes
+#define SHARE_NOPOOL SHARE_CLASSES
+#define SHARE_CACHED 64       // per thread and class before returning to shared
+#define SHARE_RETAIN (1 << 20) // bytes pooled per class, the rest is freed
+
+typedef struct {
+    memshare_t list[SHARE_CLASSES], last[SHARE_CLASSES];
+    memshare_t spare[SHARE_CLASSES]; // taken whole from shared
+    unsigned count[SHARE_CLASSES];
+    bool active;
+} sharecache_t;
 
 static const char *hex = "0123456789abcdef";
+static _Atomic(memshare_t) shared[SHARE_CLASSES];
+static atomic_size_t pooled[SHARE_CLASSES]; // in shared and spare lists
+static _Thread_local sharecache_t cache;
+static once_flag cache_once = ONCE_FLAG_INIT;
+static tss_t cache_key;
+
+static void share_push(unsigned sizeclass, memshare_t list, memshare_t last) {
+    last->next = atomic_load(&shared[sizeclass]);
+    while (!atomic_compare_exchange_weak(&shared[sizeclass], &last->next, list))
+        ;
+}
+
+static void share_flush(sharecache_t *local, unsigned sizeclass) {
+    memshare_t list = local->list[sizeclass], last = local->last[sizeclass];
+    if (!list) return;
+    unsigned count = local->count[sizeclass];
+    local->list[sizeclass] = local->last[sizeclass] = NULL;
+    local->count[sizeclass] = 0;
+    size_t limit = SHARE_RETAIN / ((size_t)128 << sizeclass);
+    if (atomic_load_explicit(&pooled[sizeclass], memory_order_relaxed) + count > limit) {
+        while (list) {
+            memshare_t next = list->next;
+            free(list);
+            list = next;
+        }
+        return;
+    }
+    atomic_fetch_add_explicit(&pooled[sizeclass], count, memory_order_relaxed);
+    share_push(sizeclass, list, last);
+}
+
+static void cache_exit(void *arg) {
+    sharecache_t *local = arg;
+    for (unsigned sizeclass = 0; sizeclass < SHARE_CLASSES; ++sizeclass) {
+        share_flush(local, sizeclass);
+        memshare_t last = local->spare[sizeclass];
+        if (!last) continue;
+        while (last->next)
+            last = last->next;
+        share_push(sizeclass, local->spare[sizeclass], last);
+        local->spare[sizeclass] = NULL;
+    }
+}
+
+static void cache_init(void) {
+    tss_create(&cache_key, cache_exit);
+}
+
+// registered on first use either way so a thread's pool goes back on exit
+static sharecache_t *share_local(void) {
+    sharecache_t *local = &cache;
+    if (!local->active) {
+        call_once(&cache_once, cache_init);
+        tss_set(cache_key, local);
+        local->active = true;
+    }
+    return local;
+}
+
+static unsigned share_class(size_t size) {
+    if (size > ((size_t)128 << (SHARE_CLASSES - 1))) return SHARE_NOPOOL;
+    unsigned sizeclass = 0;
+    while (((size_t)128 << sizeclass) < size)
+        ++sizeclass;
+    return sizeclass;
+}
+
+static memshare_t share_alloc(unsigned sizeclass) {
+    sharecache_t *local = share_local();
+    memshare_t ptr = local->list[sizeclass];
+    if (ptr) {
+        local->list[sizeclass] = ptr->next;
+        if (--local->count[sizeclass] == 0)
+            local->last[sizeclass] = NULL;
+        return ptr;
+    }
+    ptr = local->spare[sizeclass];
+    if (!ptr && atomic_load_explicit(&shared[sizeclass], memory_order_relaxed))
+        ptr = atomic_exchange(&shared[sizeclass], NULL);
+    if (!ptr) return malloc((size_t)128 << sizeclass);
+    local->spare[sizeclass] = ptr->next;
+    atomic_fetch_sub_explicit(&pooled[sizeclass], 1, memory_order_relaxed);
+    return ptr;
+}
+
+static void share_free(memshare_t ptr) {
+    unsigned sizeclass = ptr->sizeclass;
+    if (sizeclass >= SHARE_CLASSES) {
+        free(ptr);
+        return;
+    }
+
+    sharecache_t *local = share_local();
+    ptr->next = local->list[sizeclass];
+    if (!ptr->next)
+        local->last[sizeclass] = ptr;
+    local->list[sizeclass] = ptr;
+    if (++local->count[sizeclass] >= SHARE_CACHED)
+        share_flush(local, sizeclass);
+}
 
 size_t cpr_hexload(uint8_t *out, const char *str, size_t size) {
     if (!out || !size || !str) return 0;
@@ -63,9 +176,17 @@ void *cpr_memset(void *ptr, int value, size_t size) {
 }
 
 memshare_t cpr_makeref(size_t size) {
-    memshare_t ptr = (memshare_t)malloc(sizeof(struct _memshare) + size);
+    unsigned sizeclass = share_class(sizeof(struct _memshare) + size);
+    memshare_t ptr;
+    if (sizeclass < SHARE_CLASSES)
+        ptr = share_alloc(sizeclass);
+    else
+        ptr = (memshare_t)malloc(sizeof(struct _memshare) + size);
     if (!ptr) return NULL;
     atomic_init(&ptr->refcount, 1);
+    atomic_init(&ptr->weakcount, 1); // one weak count held by all strong refs
+    ptr->sizeclass = sizeclass;
+    ptr->next = NULL;
     return ptr;
 }
 
@@ -84,8 +205,29 @@ memshare_t cpr_retain(memshare_t ptr) {
 
 memshare_t cpr_release(memshare_t ptr) {
     if (atomic_fetch_sub(&ptr->refcount, 1) == 1) {
-        free(ptr);
+        if (atomic_fetch_sub(&ptr->weakcount, 1) == 1)
+            share_free(ptr);
         return NULL;
     }
     return ptr;
 }
+
+memshare_t cpr_weakref(memshare_t ptr) {
+    atomic_fetch_add(&ptr->weakcount, 1);
+    return ptr;
+}
+
+memshare_t cpr_weakrelease(memshare_t ptr) {
+    if (atomic_fetch_sub(&ptr->weakcount, 1) == 1)
+        share_free(ptr);
+    return NULL;
+}
+
+// strong ref from a weak one, or NULL once the object has been released
+memshare_t cpr_lock(memshare_t ptr) {
+    unsigned count = atomic_load(&ptr->refcount);
+    do {
+        if (!count) return NULL;
+    } while (!atomic_compare_exchange_weak(&ptr->refcount, &count, count + 1));
+    return ptr;
+}
@@ -19,8 +19,17 @@ extern "C" {
 
 typedef void (*cpr_free_t)(void *);
 
+#define CPR_CACHELINE 64
+
 typedef struct _memshare {
-    atomic_uint refcount;
+    union {
+        struct {
+            atomic_uint refcount, weakcount;
+            struct _memshare *next; // when pooled
+            unsigned sizeclass;
+        };
+        uint8_t line[CPR_CACHELINE]; // keeps payload off the counters line
+    };
 } *memshare_t;
 
 size_t cpr_hexload(uint8_t *out, const char *hex, size_t size);
@@ -34,6 +43,9 @@ void *cpr_ref(memshare_t ptr);
 unsigned cpr_count(memshare_t ptr);
 memshare_t cpr_retain(memshare_t ptr);
 memshare_t cpr_release(memshare_t ptr);
+memshare_t cpr_weakref(memshare_t ptr);
+memshare_t cpr_weakrelease(memshare_t ptr);
+memshare_t cpr_lock(memshare_t ptr);
 
 #ifndef _WIN32
 static inline FILE *cpr_memread(const void *from, size_t size) {
@@ -59,6 +71,8 @@ static inline FILE *cpr_memstring(const char *text, size_t max) {
 #define REF(ptr, T) ((T *)cpr_ref((ptr)))
 #define MAKE_REF(ptr, T) ((*(ptr) == NULL) ? (*(ptr) = cpr_makeref(sizeof(T))) : cpr_retain(*(ptr)))
 #define RELEASE_REF(ptr) (*(ptr) = cpr_release(*(ptr)))
+#define WEAK_REF(ptr) cpr_weakref((ptr))
+#define RELEASE_WEAK(ptr) (*(ptr) = cpr_weakrelease(*(ptr)))
 
 #ifdef __cplusplus
 }
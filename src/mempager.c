@@ -2,6 +2,365 @@
 // Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
 
 #include "mempager.h"
+#include "thread.h"
+
+#include <stdatomic.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define PAGER_MINBIN 4 // tails under 16 bytes are not worth keeping
+
+struct _memlarge {
+    struct _memlarge *next;
+};
+
+static inline unsigned floor_log2(size_t value) {
+    return (unsigned)(63 - __builtin_clzll((unsigned long long)value));
+}
+
+static inline unsigned ceil_log2(size_t value) {
+    return value < 2 ? 0 : floor_log2(value - 1) + 1;
+}
+
+static inline size_t align_page(mempage_t page, size_t align) {
+    uintptr_t addr = (uintptr_t)page + page->used;
+    addr = (addr + align - 1) & ~(uintptr_t)(align - 1);
+    return (size_t)(addr - (uintptr_t)page);
+}
+
+static inline size_t page_stride(size_t size) {
+    return (size + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+}
+
+#ifndef _WIN32
+#define PAGER_HUGEPAGE ((size_t)2 * 1024 * 1024)
+
+static size_t map_size(size_t size) {
+    size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + pagesize - 1) & ~(pagesize - 1);
+}
+
+static void *map_pages(size_t size) {
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (size >= PAGER_HUGEPAGE)
+        madvise(mem, size, MADV_HUGEPAGE);
+#endif
+    return mem;
+}
+
+// reserve on a huge page boundary so the region can be huge page backed
+static void *map_region(size_t size) {
+    if (size < PAGER_HUGEPAGE) return map_pages(size);
+    size_t extra = size + PAGER_HUGEPAGE;
+    uint8_t *mem = mmap(NULL, extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) return NULL;
+    uintptr_t base = ((uintptr_t)mem + PAGER_HUGEPAGE - 1) & ~(uintptr_t)(PAGER_HUGEPAGE - 1);
+    size_t lead = base - (uintptr_t)mem;
+    if (lead) munmap(mem, lead);
+    if (extra - lead > size) munmap((uint8_t *)base + size, extra - lead - size);
+#ifdef MADV_HUGEPAGE
+    madvise((void *)base, size, MADV_HUGEPAGE);
+#endif
+    return (void *)base;
+}
+#endif
+
+#define POOL_NONE UINT32_MAX
+
+// free pages are chained in batches; batches are on a tagged index stack
+typedef struct _poolpage {
+    struct _poolpage *next;
+    uint32_t chain, count;
+} *poolpage_t;
+
+typedef struct _pagecache {
+    struct _pagecache *link;
+    pagepool_t pool;
+    poolpage_t pages;
+    unsigned count;
+    atomic_bool idle; // owner thread exited, free for another to claim
+} pagecache_t;
+
+struct _pagepool {
+    atomic_uint_fast64_t batches; // tag << 32 | batch page index
+    atomic_uint carved;
+    _Atomic(pagecache_t *) caches;
+    tss_t key;
+    uint8_t *base;
+    size_t size, stride, reserved;
+    unsigned limit, batch;
+};
+
+static inline poolpage_t pool_page(pagepool_t pool, uint32_t index) {
+    return (poolpage_t)(pool->base + pool->stride * index);
+}
+
+static inline uint32_t pool_index(pagepool_t pool, poolpage_t page) {
+    return (uint32_t)(((uint8_t *)page - pool->base) / pool->stride);
+}
+
+static void pool_push(pagepool_t pool, poolpage_t list, unsigned count) {
+    uint_fast64_t head = atomic_load(&pool->batches), next;
+    list->count = count;
+    do {
+        list->chain = (uint32_t)head;
+        next = ((head >> 32) + 1) << 32 | pool_index(pool, list);
+    } while (!atomic_compare_exchange_weak(&pool->batches, &head, next));
+}
+
+static poolpage_t pool_pop(pagepool_t pool, unsigned *count) {
+    uint_fast64_t head = atomic_load(&pool->batches), next;
+    poolpage_t list;
+    do {
+        if ((uint32_t)head == POOL_NONE) return NULL;
+        list = pool_page(pool, (uint32_t)head);
+        next = ((head >> 32) + 1) << 32 | list->chain;
+    } while (!atomic_compare_exchange_weak(&pool->batches, &head, next));
+    *count = list->count;
+    return list;
+}
+
+static poolpage_t pool_carve(pagepool_t pool, unsigned *count) {
+    unsigned first = atomic_load(&pool->carved), last;
+    do {
+        if (first >= pool->limit) return NULL;
+        last = first + pool->batch;
+        if (last > pool->limit) last = pool->limit;
+    } while (!atomic_compare_exchange_weak(&pool->carved, &first, last));
+
+    poolpage_t list = NULL;
+    *count = last - first;
+    while (last > first) {
+        poolpage_t page = pool_page(pool, --last);
+        page->next = list;
+        list = page;
+    }
+    return list;
+}
+
+static void cache_flush(pagepool_t pool, pagecache_t *cache, unsigned keep) {
+    while (cache->count > keep) {
+        unsigned count = cache->count - keep;
+        if (count > pool->batch) count = pool->batch;
+        poolpage_t list = cache->pages, tail = list;
+        for (unsigned pos = 1; pos < count; ++pos)
+            tail = tail->next;
+        cache->pages = tail->next;
+        cache->count -= count;
+        tail->next = NULL;
+        pool_push(pool, list, count);
+    }
+}
+
+// pages go back to the pool and the record to whichever thread comes next
+static void cache_exit(void *arg) {
+    pagecache_t *cache = arg;
+    if (!cache) return;
+    if (cache->count)
+        cache_flush(cache->pool, cache, 0);
+    atomic_store(&cache->idle, true);
+}
+
+static pagecache_t *pool_cache(pagepool_t pool) {
+    pagecache_t *cache = tss_get(pool->key);
+    if (cache) return cache;
+    for (cache = atomic_load(&pool->caches); cache; cache = cache->link) {
+        bool idle = true;
+        if (atomic_load(&cache->idle) && atomic_compare_exchange_strong(&cache->idle, &idle, false)) {
+            tss_set(pool->key, cache);
+            return cache;
+        }
+    }
+    cache = malloc(sizeof(pagecache_t));
+    if (!cache) return NULL;
+    cache->pool = pool;
+    cache->pages = NULL;
+    cache->count = 0;
+    atomic_init(&cache->idle, false);
+    cache->link = atomic_load(&pool->caches);
+    while (!atomic_compare_exchange_weak(&pool->caches, &cache->link, cache))
+        ;
+    tss_set(pool->key, cache);
+    return cache;
+}
+
+static mempage_t pool_get(pagepool_t pool) {
+    pagecache_t *cache = pool_cache(pool);
+    if (!cache) return NULL;
+    if (!cache->pages) {
+        cache->pages = pool_pop(pool, &cache->count);
+        if (!cache->pages)
+            cache->pages = pool_carve(pool, &cache->count);
+        if (!cache->pages) return NULL;
+    }
+    poolpage_t page = cache->pages;
+    cache->pages = page->next;
+    --cache->count;
+    return (mempage_t)page;
+}
+
+static void pool_put(pagepool_t pool, mempage_t page) {
+    pagecache_t *cache = pool_cache(pool);
+    if (!cache) {
+        poolpage_t list = (poolpage_t)page;
+        list->next = NULL;
+        pool_push(pool, list, 1);
+        return;
+    }
+    ((poolpage_t)page)->next = cache->pages;
+    cache->pages = (poolpage_t)page;
+    if (++cache->count >= pool->batch * 2)
+        cache_flush(pool, cache, pool->batch);
+}
+
+pagepool_t pagepool_create(size_t pagesize, unsigned max, unsigned batch) {
+    if (!max || !batch || max >= POOL_NONE || pagesize < sizeof(struct _mempage)) return NULL;
+    pagepool_t pool = malloc(sizeof(struct _pagepool));
+    if (!pool) return NULL;
+    pool->size = pagesize;
+    pool->stride = page_stride(pagesize);
+    pool->limit = max;
+    pool->batch = batch;
+#ifdef _WIN32
+    pool->reserved = pool->stride * max;
+    pool->base = malloc(pool->reserved);
+#else
+    pool->reserved = map_size(pool->stride * max);
+    pool->base = map_region(pool->reserved);
+#endif
+    if (!pool->base || tss_create(&pool->key, cache_exit) != thrd_success) {
+#ifdef _WIN32
+        free(pool->base);
+#else
+        if (pool->base) munmap(pool->base, pool->reserved);
+#endif
+        free(pool);
+        return NULL;
+    }
+    atomic_init(&pool->batches, POOL_NONE);
+    atomic_init(&pool->carved, 0);
+    atomic_init(&pool->caches, NULL);
+    return pool;
+}
+
+// pagers and threads must be done with the pool
+void pagepool_free(pagepool_t pool) {
+    if (!pool) return;
+    tss_delete(pool->key);
+    pagecache_t *cache = atomic_load(&pool->caches);
+    while (cache) {
+        pagecache_t *next = cache->link;
+        free(cache);
+        cache = next;
+    }
+#ifdef _WIN32
+    free(pool->base);
+#else
+    munmap(pool->base, pool->reserved);
+#endif
+    free(pool);
+}
+
+static mempage_t alloc_page(mempager_t pager) {
+    switch (pager->source) {
+#ifndef _WIN32
+    case PAGER_MMAP:
+        return (mempage_t)map_pages(map_size(pager->size));
+    case PAGER_REGION:
+        if (pager->count >= pager->limit) return NULL;
+        return (mempage_t)(pager->region + page_stride(pager->size) * pager->count);
+#endif
+    case PAGER_POOL:
+        return pool_get(pager->pool);
+    default:
+        return (mempage_t)malloc(pager->size);
+    }
+}
+
+static void release_page(mempager_t pager, mempage_t page) {
+    switch (pager->source) {
+#ifndef _WIN32
+    case PAGER_MMAP:
+        munmap(page, map_size(pager->size));
+        return;
+    case PAGER_REGION:
+        return;
+#endif
+    case PAGER_POOL:
+        pool_put(pager->pool, page);
+        return;
+    default:
+        free(page);
+    }
+}
+
+static void *large_alloc(mempager_t pager, size_t size, size_t align) {
+    if (size > SIZE_MAX - sizeof(struct _memlarge) - (align - 1))
+        return NULL;
+
+    struct _memlarge *large = malloc(sizeof(struct _memlarge) + size + align - 1);
+    if (!large) return NULL;
+    large->next = pager->large;
+    pager->large = large;
+    uintptr_t addr = (uintptr_t)(large + 1);
+    return (void *)((addr + align - 1) & ~(uintptr_t)(align - 1));
+}
+
+static void large_free(mempager_t pager, struct _memlarge *until) {
+    while (pager->large != until) {
+        struct _memlarge *next = pager->large->next;
+        free(pager->large);
+        pager->large = next;
+    }
+}
+
+static inline unsigned page_bin(mempager_t pager, mempage_t page) {
+    unsigned bin = floor_log2(pager->size - page->used);
+    return bin < PAGER_BINS ? bin : PAGER_BINS - 1;
+}
+
+static void bin_page(mempager_t pager, mempage_t page) {
+    if (pager->size - page->used < ((size_t)1 << PAGER_MINBIN)) return;
+    unsigned bin = page_bin(pager, page);
+    page->bprev = NULL;
+    page->bnext = pager->bins[bin];
+    if (page->bnext)
+        page->bnext->bprev = page;
+    pager->bins[bin] = page;
+    pager->binmap |= (uint32_t)1 << bin;
+}
+
+static void unlink_page(mempager_t pager, mempage_t page) {
+    if (pager->size - page->used < ((size_t)1 << PAGER_MINBIN)) return;
+    unsigned bin = page_bin(pager, page);
+    if (page->bprev)
+        page->bprev->bnext = page->bnext;
+    else if (pager->bins[bin] == page)
+        pager->bins[bin] = page->bnext;
+    else
+        return; // not binned
+    if (page->bnext)
+        page->bnext->bprev = page->bprev;
+    if (!pager->bins[bin])
+        pager->binmap &= ~((uint32_t)1 << bin);
+    page->bnext = page->bprev = NULL;
+}
+
+static mempage_t unbin_page(mempager_t pager, size_t size) {
+    unsigned bin = ceil_log2(size);
+    if (bin < PAGER_MINBIN) bin = PAGER_MINBIN;
+    if (bin >= PAGER_BINS) return NULL;
+    uint32_t avail = pager->binmap & ~(((uint32_t)1 << bin) - 1);
+    if (!avail) return NULL;
+    mempage_t page = pager->bins[__builtin_ctz(avail)];
+    unlink_page(pager, page);
+    return page;
+}
 
 mempager_t pager_create(size_t pagesize, unsigned max) {
     mempager_t pager = (mempager_t)malloc(sizeof(struct _mempager));
@@ -10,11 +369,62 @@ mempager_t pager_create(size_t pagesize, unsigned max) {
 
     pager->limit = max;
     pager->size = pagesize;
+    pager->align = _Alignof(max_align_t);
+    pager->source = PAGER_MALLOC;
+    pager->pool = NULL;
+    pager->stats = NULL;
+    pager->region = NULL;
+    pager->reserved = 0;
     pager->count = 0;
+    pager->binmap = 0;
     pager->head = pager->tail = pager->free = NULL;
+    pager->large = NULL;
+    memset(pager->bins, 0, sizeof(pager->bins));
     return pager;
 }
 
+bool pager_source(mempager_t pager, pager_source_t source) {
+    if (!pager || pager->count || source == PAGER_POOL)
+        return false;
+
+#ifdef _WIN32
+    if (source != PAGER_MALLOC)
+        return false;
+#else
+    if (pager->region) {
+        munmap(pager->region, pager->reserved);
+        pager->region = NULL;
+        pager->reserved = 0;
+    }
+
+    if (source == PAGER_REGION) {
+        if (!pager->limit)
+            return false;
+
+        size_t reserve = map_size(page_stride(pager->size) * pager->limit);
+        pager->region = map_region(reserve);
+        if (!pager->region)
+            return false;
+        pager->reserved = reserve;
+    }
+#endif
+    pager->source = source;
+    pager->pool = NULL;
+    return true;
+}
+
+bool pager_pool(mempager_t pager, pagepool_t pool) {
+    if (!pager || !pool || pool->size < pager->size)
+        return false;
+
+    if (!pager_source(pager, PAGER_MALLOC))
+        return false;
+
+    pager->source = PAGER_POOL;
+    pager->pool = pool;
+    return true;
+}
+
 void *pager_data(mempage_t page) {
     if (!page)
         return NULL;
@@ -26,19 +436,65 @@ void pager_reset(mempager_t pager) {
     mempage_t next, page = pager->free;
     while (page) {
         next = page->next;
-        free(page);
+        release_page(pager, page);
         page = next;
     }
 
     page = pager->head;
     while (page) {
         next = page->next;
-        free(page);
+        release_page(pager, page);
         page = next;
     }
 
+    large_free(pager, NULL);
     pager->count = 0;
+    pager->binmap = 0;
     pager->head = pager->tail = pager->free = NULL;
+    memset(pager->bins, 0, sizeof(pager->bins));
+}
+
+void pager_recycle(mempager_t pager) {
+    if (!pager)
+        return;
+
+    large_free(pager, NULL);
+    if (!pager->head)
+        return;
+
+    pager->tail->next = pager->free;
+    pager->free = pager->head;
+    pager->binmap = 0;
+    pager->head = pager->tail = NULL;
+    memset(pager->bins, 0, sizeof(pager->bins));
+}
+
+pager_mark_t pager_mark(mempager_t pager) {
+    pager_mark_t mark = {.page = pager->tail, .large = pager->large, .used = 0};
+    if (mark.page)
+        mark.used = mark.page->used;
+    return mark;
+}
+
+// space taken from older binned pages after the mark is kept until reset
+void pager_rollback(mempager_t pager, pager_mark_t mark) {
+    mempage_t next, page = mark.page ? mark.page->next : pager->head;
+    large_free(pager, mark.large);
+    while (page) {
+        next = page->next;
+        unlink_page(pager, page);
+        page->next = pager->free;
+        pager->free = page;
+        page = next;
+    }
+
+    if (mark.page) {
+        unlink_page(pager, mark.page);
+        mark.page->next = NULL;
+        mark.page->used = mark.used;
+        pager->tail = mark.page;
+    } else
+        pager->head = pager->tail = NULL;
 }
 
 void pager_free(mempager_t pager) {
@@ -46,27 +502,81 @@ void pager_free(mempager_t pager) {
         return;
 
     pager_reset(pager);
+#ifndef _WIN32
+    if (pager->region)
+        munmap(pager->region, pager->reserved);
+#endif
+    free(pager->stats);
     free(pager);
 }
 
+// default alignment for pager_alloc, a power of two
+bool pager_align(mempager_t pager, size_t align) {
+    if (!pager || !align || (align & (align - 1)))
+        return false;
+
+    pager->align = align;
+    return true;
+}
+
+bool pager_track(mempager_t pager, bool enable) {
+    if (!pager)
+        return false;
+
+    if (!enable) {
+        free(pager->stats);
+        pager->stats = NULL;
+        return true;
+    }
+
+    if (!pager->stats)
+        pager->stats = malloc(sizeof(pager_stats_t));
+    if (!pager->stats)
+        return false;
+
+    memset(pager->stats, 0, sizeof(pager_stats_t));
+    pager->stats->highwater = pager->count;
+    return true;
+}
+
+bool pager_stats(mempager_t pager, pager_stats_t *stats) {
+    if (!pager || !pager->stats || !stats)
+        return false;
+
+    *stats = *pager->stats;
+    stats->wasted = 0;
+    for (mempage_t page = pager->head; page && page != pager->tail; page = page->next)
+        stats->wasted += pager->size - page->used;
+    return true;
+}
+
 mempage_t pager_request(mempager_t pager) {
     mempage_t page = pager->free;
-    if (page)
+    if (page) {
         pager->free = page->next;
-    else if (pager->limit && pager->count >= pager->limit)
+        if (pager->stats)
+            ++pager->stats->reused;
+    } else if (pager->limit && pager->count >= pager->limit)
         return NULL;
     else {
-        page = (mempage_t)malloc(pager->size);
+        page = alloc_page(pager);
         if (!page)
             return NULL;
         ++pager->count;
+        if (pager->stats && pager->count > pager->stats->highwater)
+            pager->stats->highwater = pager->count;
     }
 
-    if (pager->tail)
+    if (pager->stats)
+        ++pager->stats->pages;
+
+    if (pager->tail) {
         pager->tail->next = page;
-    else
+        bin_page(pager, pager->tail);
+    } else
         pager->head = page;
 
+    page->bnext = page->bprev = NULL;
     page->prev = pager->tail;
     page->next = NULL;
     page->used = sizeof(struct _mempage);
@@ -74,37 +584,294 @@ mempage_t pager_request(mempager_t pager) {
     return page;
 }
 
-void *pager_alloc(mempager_t pager, size_t size) {
-    uint8_t *data;
+void *pager_aligned_alloc(mempager_t pager, size_t size, size_t align) {
+    size_t offset;
     mempage_t page;
 
-    if (size + sizeof(struct _mempage) > pager->size)
+    if (!align || (align & (align - 1)))
         return NULL;
 
-    page = pager->head;
-    while (page) {
-        if (page->used + size <= pager->size) {
-            data = ((uint8_t *)page) + page->used;
-            page->used += size;
-            return data;
+    // header and alignment slack are added to size below
+    if (size > SIZE_MAX - sizeof(struct _mempage) - (align - 1))
+        return NULL;
+
+    if (pager->stats) {
+        ++pager->stats->allocs;
+        pager->stats->requested += size;
+    }
+
+    if (size + sizeof(struct _mempage) + align - 1 > pager->size) {
+        if (pager->stats)
+            ++pager->stats->large;
+        return large_alloc(pager, size, align);
+    }
+
+    page = pager->tail;
+    if (page) {
+        offset = align_page(page, align);
+        if (offset + size <= pager->size) {
+            page->used = offset + size;
+            return ((uint8_t *)page) + offset;
         }
-        page = page->next;
+    }
+
+    page = unbin_page(pager, size + align - 1);
+    if (page) {
+        offset = align_page(page, align);
+        page->used = offset + size;
+        bin_page(pager, page);
+        return ((uint8_t *)page) + offset;
     }
 
     page = pager_request(pager);
     if (!page)
         return NULL;
 
-    page->used += size;
-    return ((uint8_t *)page) + sizeof(struct _mempage);
+    offset = align_page(page, align);
+    if (offset + size > pager->size)
+        return NULL;
+
+    page->used = offset + size;
+    return ((uint8_t *)page) + offset;
+}
+
+void *pager_alloc(mempager_t pager, size_t size) {
+    return pager_aligned_alloc(pager, size, pager->align);
 }
 
 char *pager_strdup(mempager_t pager, const char *str) {
-    size_t size = cpr_strlen(str, pager->size - sizeof(struct _mempage) - 1);
-    char *out = pager_alloc(pager, ++size);
+    if (!str)
+        return NULL;
+
+    size_t size = cpr_strlen(str, SIZE_MAX);
+    char *out = pager_aligned_alloc(pager, size + 1, 1);
     if (!out)
         return NULL;
 
-    cpr_strcpy(out, str, size);
+    memcpy(out, str, size); // FlawFinder: ignore
+    out[size] = 0;
     return out;
 }
+
+memslab_t slab_create(size_t size, unsigned perpage, unsigned max, unsigned flags) {
+    if (!size || !perpage)
+        return NULL;
+
+    size_t align = (flags & SLAB_CACHELINE) ? 64 : _Alignof(max_align_t);
+    if (size < sizeof(void *))
+        size = sizeof(void *);
+
+    memslab_t slab = malloc(sizeof(struct _memslab));
+    if (!slab)
+        return NULL;
+
+    slab->slot = (size + align - 1) & ~(align - 1);
+    slab->pager = pager_create(sizeof(struct _mempage) + align + slab->slot * perpage, max);
+    if (!slab->pager) {
+        free(slab);
+        return NULL;
+    }
+
+    pager_align(slab->pager, align);
+    slab->free = NULL;
+    slab->next = slab->end = NULL;
+    slab->flags = flags;
+    atomic_init(&slab->remote, NULL);
+    return slab;
+}
+
+// with SLAB_SHARED, only the owning thread may allocate
+void *slab_alloc(memslab_t slab) {
+    void *obj = slab->free;
+    if (!obj && (slab->flags & SLAB_SHARED) && atomic_load_explicit(&slab->remote, memory_order_relaxed))
+        obj = atomic_exchange_explicit(&slab->remote, NULL, memory_order_acquire);
+
+    if (obj) {
+        slab->free = *(void **)obj;
+        return obj;
+    }
+
+    if (!slab->next || slab->next + slab->slot > slab->end) {
+        mempage_t page = pager_request(slab->pager);
+        if (!page)
+            return NULL;
+
+        uintptr_t addr = (uintptr_t)pager_data(page);
+        addr = (addr + slab->pager->align - 1) & ~(uintptr_t)(slab->pager->align - 1);
+        slab->next = (uint8_t *)addr;
+        slab->end = (uint8_t *)page + slab->pager->size;
+        page->used = slab->pager->size;
+    }
+
+    obj = slab->next;
+    slab->next += slab->slot;
+    return obj;
+}
+
+void slab_release(memslab_t slab, void *obj) {
+    if (!slab || !obj)
+        return;
+
+    if (!(slab->flags & SLAB_SHARED)) {
+        *(void **)obj = slab->free;
+        slab->free = obj;
+        return;
+    }
+
+    void *head = atomic_load_explicit(&slab->remote, memory_order_relaxed);
+    do {
+        *(void **)obj = head;
+    } while (!atomic_compare_exchange_weak_explicit(&slab->remote, &head, obj, memory_order_release, memory_order_relaxed));
+}
+
+void slab_free(memslab_t slab) {
+    if (!slab)
+        return;
+
+    pager_free(slab->pager);
+    free(slab);
+}
+
+static uint32_t strtab_hash(const char *str, size_t len) {
+    uint32_t hash = 2166136261U;
+    while (len--) {
+        hash ^= (uint8_t)*(str++);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static inline bool strtab_match(strtab_t tab, size_t slot, const char *str, size_t len) {
+    return tab->lengths[slot] == len && memcmp(tab->keys[slot], str, len) == 0;
+}
+
+// slot holding the string, or the empty slot where it would go
+static size_t strtab_probe(strtab_t tab, const char *str, size_t len, uint32_t hash) {
+    size_t slot = hash & (tab->size - 1);
+    while (tab->keys[slot]) {
+        if (tab->hashes[slot] == hash && strtab_match(tab, slot, str, len))
+            break;
+        slot = (slot + 1) & (tab->size - 1);
+    }
+    return slot;
+}
+
+static bool strtab_grow(strtab_t tab) {
+    size_t size = tab->size * 2;
+    const char **keys = calloc(size, sizeof(const char *));
+    uint32_t *hashes = malloc(size * sizeof(uint32_t));
+    size_t *lengths = malloc(size * sizeof(size_t));
+    if (!keys || !hashes || !lengths) {
+        free(keys);
+        free(hashes);
+        free(lengths);
+        return false;
+    }
+
+    for (size_t pos = 0; pos < tab->size; ++pos) {
+        if (!tab->keys[pos]) continue;
+        size_t slot = tab->hashes[pos] & (size - 1);
+        while (keys[slot])
+            slot = (slot + 1) & (size - 1);
+        keys[slot] = tab->keys[pos];
+        hashes[slot] = tab->hashes[pos];
+        lengths[slot] = tab->lengths[pos];
+    }
+
+    free(tab->keys);
+    free(tab->hashes);
+    free(tab->lengths);
+    tab->keys = keys;
+    tab->hashes = hashes;
+    tab->lengths = lengths;
+    tab->size = size;
+    return true;
+}
+
+strtab_t strtab_create(mempager_t pager, size_t size) {
+    if (!pager)
+        return NULL;
+
+    size_t slots = 16;
+    while (slots < size * 2)
+        slots *= 2;
+
+    strtab_t tab = malloc(sizeof(struct _strtab));
+    if (!tab)
+        return NULL;
+
+    tab->pager = pager;
+    tab->size = slots;
+    tab->count = 0;
+    tab->keys = calloc(slots, sizeof(const char *));
+    tab->hashes = malloc(slots * sizeof(uint32_t));
+    tab->lengths = malloc(slots * sizeof(size_t));
+    if (!tab->keys || !tab->hashes || !tab->lengths) {
+        strtab_free(tab);
+        return NULL;
+    }
+    return tab;
+}
+
+const char *strtab_nfind(strtab_t tab, const char *str, size_t len) {
+    if (!tab || !str)
+        return NULL;
+
+    return tab->keys[strtab_probe(tab, str, len, strtab_hash(str, len))];
+}
+
+// equal strings always return the same pointer, so they compare by address
+const char *strtab_nintern(strtab_t tab, const char *str, size_t len) {
+    if (!tab || !str)
+        return NULL;
+
+    uint32_t hash = strtab_hash(str, len);
+    size_t slot = strtab_probe(tab, str, len, hash);
+    if (tab->keys[slot])
+        return tab->keys[slot];
+
+    if ((tab->count + 1) * 4 > tab->size * 3) {
+        if (!strtab_grow(tab))
+            return NULL;
+        slot = strtab_probe(tab, str, len, hash);
+    }
+
+    char *key = pager_aligned_alloc(tab->pager, len + 1, 1);
+    if (!key)
+        return NULL;
+
+    memcpy(key, str, len); // FlawFinder: ignore
+    key[len] = 0;
+    tab->keys[slot] = key;
+    tab->hashes[slot] = hash;
+    tab->lengths[slot] = len;
+    ++tab->count;
+    return key;
+}
+
+const char *strtab_intern(strtab_t tab, const char *str) {
+    return strtab_nintern(tab, str, cpr_strlen(str, SIZE_MAX));
+}
+
+const char *strtab_find(strtab_t tab, const char *str) {
+    return strtab_nfind(tab, str, cpr_strlen(str, SIZE_MAX));
+}
+
+// call after resetting the pager that holds the strings
+void strtab_clear(strtab_t tab) {
+    if (!tab)
+        return;
+
+    memset(tab->keys, 0, tab->size * sizeof(const char *));
+    tab->count = 0;
+}
+
+void strtab_free(strtab_t tab) {
+    if (!tab)
+        return;
+
+    free(tab->keys);
+    free(tab->hashes);
+    free(tab->lengths);
+    free(tab);
+}
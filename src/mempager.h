@@ -7,7 +7,9 @@
 #include <memory.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 #include "strchar.h"
 
@@ -15,28 +17,107 @@
 extern "C" {
 #endif
 
+#define PAGER_BINS 32
+
 typedef struct _mempage {
-    struct _mempage *next, *prev;
+    struct _mempage *next, *prev, *bnext, *bprev;
     size_t used;
 } *mempage_t;
 
+typedef enum {
+    PAGER_MALLOC = 0,
+    PAGER_MMAP,   // anonymous mapping per page, huge pages advised
+    PAGER_REGION, // one reserved region carved into limit pages
+    PAGER_POOL    // pages shared thru a pagepool_t
+} pager_source_t;
+
+typedef struct _pagepool *pagepool_t;
+
+typedef struct {
+    size_t requested, wasted; // wasted is space left behind at page tails
+    size_t allocs, large;
+    size_t pages, reused; // page requests, and those from the free list
+    unsigned highwater;   // most pages held at once
+} pager_stats_t;
+
 typedef struct _mempager {
     mempage_t head, tail, free;
-    size_t size;
+    struct _memlarge *large; // objects too big for a page
+    mempage_t bins[PAGER_BINS]; // older pages by log2 of space left
+    uint32_t binmap;
+    pager_source_t source;
+    pagepool_t pool;
+    pager_stats_t *stats; // only when tracking
+    uint8_t *region;
+    size_t reserved;
+    size_t size, align; // align is default for pager_alloc
     unsigned limit, count;
 } *mempager_t;
 
+typedef struct {
+    mempage_t page;
+    struct _memlarge *large;
+    size_t used;
+} pager_mark_t;
+
+enum {
+    SLAB_CACHELINE = 1, // slots padded to whole cache lines
+    SLAB_SHARED = 2     // objects may be released from any thread
+};
+
+typedef struct _memslab {
+    mempager_t pager;
+    void *free;
+    _Atomic(void *) remote; // shared releases, taken back by slab_alloc
+    uint8_t *next, *end;    // uncarved slots of the current page
+    size_t slot;
+    unsigned flags;
+} *memslab_t;
+
+typedef struct _strtab {
+    mempager_t pager; // holds the interned strings
+    const char **keys;
+    uint32_t *hashes;
+    size_t *lengths;
+    size_t size, count;
+} *strtab_t;
+
 mempager_t pager_create(size_t pagesize, unsigned max);
+bool pager_source(mempager_t pager, pager_source_t source);
+bool pager_pool(mempager_t pager, pagepool_t pool);
+pagepool_t pagepool_create(size_t pagesize, unsigned max, unsigned batch);
+void pagepool_free(pagepool_t pool);
 void *pager_data(mempage_t page);
 void pager_reset(mempager_t pager);
+void pager_recycle(mempager_t pager);
+pager_mark_t pager_mark(mempager_t pager);
+void pager_rollback(mempager_t pager, pager_mark_t mark);
 void pager_free(mempager_t pager);
+bool pager_align(mempager_t pager, size_t align);
+bool pager_track(mempager_t pager, bool enable);
+bool pager_stats(mempager_t pager, pager_stats_t *stats);
 mempage_t pager_request(mempager_t pager);
 void *pager_alloc(mempager_t pager, size_t size);
+void *pager_aligned_alloc(mempager_t pager, size_t size, size_t align);
 char *pager_strdup(mempager_t pager, const char *str);
+memslab_t slab_create(size_t size, unsigned perpage, unsigned max, unsigned flags);
+void *slab_alloc(memslab_t slab);
+void slab_release(memslab_t slab, void *obj);
+void slab_free(memslab_t slab);
+strtab_t strtab_create(mempager_t pager, size_t size);
+const char *strtab_intern(strtab_t tab, const char *str);
+const char *strtab_nintern(strtab_t tab, const char *str, size_t len);
+const char *strtab_find(strtab_t tab, const char *str);
+const char *strtab_nfind(strtab_t tab, const char *str, size_t len);
+void strtab_clear(strtab_t tab);
+void strtab_free(strtab_t tab);
 
-#define PAGER(mem, T) (T *)pager_alloc(mem, sizeof(T))
-#define MAKE_PAGER(T, max) pager_create(sizeof(T), max)
+#define PAGER(mem, T) (T *)pager_aligned_alloc(mem, sizeof(T), _Alignof(T))
+#define MAKE_PAGER(T, max) pager_create(sizeof(struct _mempage) + _Alignof(max_align_t) + sizeof(T), max)
 #define FREE_PAGER(ptr) pager_free(ptr)
+#define SLAB(slab, T) (T *)slab_alloc(slab)
+#define MAKE_SLAB(T, max) slab_create(sizeof(T), 64, max, 0)
+#define FREE_SLAB(ptr) slab_free(ptr)
 
 #ifdef __cplusplus
 }
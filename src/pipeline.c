@@ -5,9 +5,34 @@
 
 #include <stdlib.h>
 
-pipeline_t *make_pipeline(size_t size, int policy, cpr_free_t ff) {
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+#define LOCKFREE_SPINS 16 // yields before sleeping on an empty or full ring
+#define SELECT_MAX 64     // pipelines one select can wait on
+
+static const deadline_t nowait = {0}; // always expired, for try calls
+
+static pipeline_t *alloc_pipeline(size_t size, int policy, int mode, cpr_free_t ff) {
+    if (!size || size > (SIZE_MAX >> 2)) return NULL;
+    size_t ring = mode == MPMC ? 2 : 1; // cell sequences need two cells
+    while (ring < size)
+        ring <<= 1;
+    size = ring;
     size_t alloc = sizeof(pipeline_t) + (size * sizeof(void *));
-    pipeline_t *pl = malloc(alloc);
+    if (mode == MPMC)
+        alloc += size * sizeof(atomic_size_t);
+    alloc = (alloc + CPR_CACHELINE - 1) & ~(size_t)(CPR_CACHELINE - 1);
+#ifdef _WIN32
+    pipeline_t *pl = _aligned_malloc(alloc, CPR_CACHELINE);
+#else
+    pipeline_t *pl = aligned_alloc(CPR_CACHELINE, alloc); // index lines
+#endif
     if (!pl) return NULL;
     cpr_memset(pl, 0, alloc);
     if (ff == NULL) ff = &free;
@@ -16,54 +41,435 @@ pipeline_t *make_pipeline(size_t size, int policy, cpr_free_t ff) {
     cnd_init(&pl->output);
     pl->head = pl->tail = pl->count = 0;
     pl->size = size;
+    pl->mask = size - 1;
     pl->policy = policy;
+    pl->mode = mode;
     pl->free = ff;
     atomic_init(&pl->closed, false);
+    atomic_init(&pl->getwait, 0);
+    atomic_init(&pl->putwait, 0);
+    atomic_init(&pl->rd, 0);
+    atomic_init(&pl->wr, 0);
+#ifndef _WIN32
+    pl->ready.fds[0] = pl->ready.fds[1] = -1;
+    atomic_init(&pl->pollable, false);
+    atomic_init(&pl->signaled, false);
+#endif
+    pl->seq = NULL;
+    if (mode == MPMC) {
+        pl->seq = (atomic_size_t *)&pl->buf[size];
+        for (size_t cell = 0; cell < size; ++cell)
+            atomic_init(&pl->seq[cell], cell);
+    }
     return pl;
 }
 
+pipeline_t *make_pipeline(size_t size, int policy, cpr_free_t ff) {
+    return alloc_pipeline(size, policy, LOCKED, ff);
+}
+
+pipeline_t *make_spsc_pipeline(size_t size, int policy, cpr_free_t ff) {
+    return alloc_pipeline(size, policy, SPSC, ff);
+}
+
+pipeline_t *make_mpmc_pipeline(size_t size, int policy, cpr_free_t ff) {
+    return alloc_pipeline(size, policy, MPMC, ff);
+}
+
+// take the oldest item, with a cas if drop policy lets the producer take too
+static bool take_spsc(pipeline_t *pl, void **out) {
+    size_t rd = atomic_load_explicit(&pl->rd, memory_order_relaxed);
+    for (;;) {
+        if ((intptr_t)(pl->wrseen - rd) <= 0) { // producer drops can pass it
+            pl->wrseen = atomic_load_explicit(&pl->wr, memory_order_acquire);
+            if (rd == pl->wrseen) return false;
+        }
+        *out = pl->buf[rd & pl->mask];
+        if (pl->policy != DROP) {
+            atomic_store_explicit(&pl->rd, rd + 1, memory_order_release);
+            return true;
+        }
+        if (atomic_compare_exchange_weak_explicit(&pl->rd, &rd, rd + 1, memory_order_acq_rel, memory_order_relaxed))
+            return true;
+    }
+}
+
+static bool give_spsc(pipeline_t *pl, void *ptr) {
+    size_t wr = atomic_load_explicit(&pl->wr, memory_order_relaxed);
+    if (wr - pl->rdseen >= pl->size) {
+        pl->rdseen = atomic_load_explicit(&pl->rd, memory_order_acquire);
+        if (wr - pl->rdseen >= pl->size) return false;
+    }
+    pl->buf[wr & pl->mask] = ptr;
+    atomic_store_explicit(&pl->wr, wr + 1, memory_order_release);
+    return true;
+}
+
+// producer side of drop policy, as the consumer owns wrseen
+static void drop_spsc(pipeline_t *pl) {
+    size_t rd = atomic_load(&pl->rd);
+    if (rd == atomic_load(&pl->wr)) return;
+    void *drop = pl->buf[rd & pl->mask];
+    if (atomic_compare_exchange_strong(&pl->rd, &rd, rd + 1) && drop)
+        pl->free(drop);
+}
+
+// bounded queue where each cell sequence says whose turn it is
+static bool take_mpmc(pipeline_t *pl, void **out) {
+    size_t rd = atomic_load_explicit(&pl->rd, memory_order_relaxed);
+    for (;;) {
+        size_t cell = rd & pl->mask;
+        size_t seq = atomic_load_explicit(&pl->seq[cell], memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(rd + 1);
+        if (diff < 0) return false;
+        if (diff > 0)
+            rd = atomic_load_explicit(&pl->rd, memory_order_relaxed);
+        else if (atomic_compare_exchange_weak_explicit(&pl->rd, &rd, rd + 1, memory_order_relaxed, memory_order_relaxed)) {
+            *out = pl->buf[cell];
+            atomic_store_explicit(&pl->seq[cell], rd + pl->size, memory_order_release);
+            return true;
+        }
+    }
+}
+
+static bool give_mpmc(pipeline_t *pl, void *ptr) {
+    size_t wr = atomic_load_explicit(&pl->wr, memory_order_relaxed);
+    for (;;) {
+        size_t cell = wr & pl->mask;
+        size_t seq = atomic_load_explicit(&pl->seq[cell], memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)wr;
+        if (diff < 0) return false;
+        if (diff > 0)
+            wr = atomic_load_explicit(&pl->wr, memory_order_relaxed);
+        else if (atomic_compare_exchange_weak_explicit(&pl->wr, &wr, wr + 1, memory_order_relaxed, memory_order_relaxed)) {
+            pl->buf[cell] = ptr;
+            atomic_store_explicit(&pl->seq[cell], wr + 1, memory_order_release);
+            return true;
+        }
+    }
+}
+
+static inline bool take_item(pipeline_t *pl, void **out) {
+    return pl->mode == SPSC ? take_spsc(pl, out) : take_mpmc(pl, out);
+}
+
+static inline bool give_item(pipeline_t *pl, void *ptr) {
+    return pl->mode == SPSC ? give_spsc(pl, ptr) : give_mpmc(pl, ptr);
+}
+
+// wait on a pipeline condition, false once the deadline has passed
+static bool wait_pipeline(pipeline_t *pl, cnd_t *cond, const deadline_t *deadline) {
+    if (!deadline) return cnd_wait(cond, &pl->lock) == thrd_success;
+    struct timespec ts;
+    if (!cpr_realtime(deadline, &ts)) return false;
+    return cnd_timedwait(cond, &pl->lock, &ts) != thrd_timedout;
+}
+
+// wake peers that went to sleep in the lock-free slow path
+static void wake_peer(pipeline_t *pl, atomic_uint *waiting, cnd_t *cond, size_t count) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(waiting, memory_order_relaxed)) return;
+    mtx_lock(&pl->lock);
+    if (count > 1)
+        cnd_broadcast(cond);
+    else
+        cnd_signal(cond);
+    mtx_unlock(&pl->lock);
+}
+
+static size_t get_lockfree(pipeline_t *pl, void **out, size_t max, const deadline_t *deadline) {
+    unsigned spins = 0;
+    while (!atomic_load(&pl->closed)) {
+        size_t count = 0;
+        while (count < max && take_item(pl, &out[count]))
+            ++count;
+        if (count) {
+            wake_peer(pl, &pl->putwait, &pl->input, count);
+            return count;
+        }
+        if (deadline && !cpr_expires(deadline, NULL)) break;
+        if (++spins < LOCKFREE_SPINS) {
+            thrd_yield();
+            continue;
+        }
+        bool waiting = true;
+        mtx_lock(&pl->lock);
+        atomic_fetch_add(&pl->getwait, 1);
+        if (atomic_load(&pl->rd) == atomic_load(&pl->wr) && !atomic_load(&pl->closed))
+            waiting = wait_pipeline(pl, &pl->output, deadline);
+        atomic_fetch_sub(&pl->getwait, 1);
+        mtx_unlock(&pl->lock);
+        if (!waiting) break;
+    }
+    return 0;
+}
+
+static size_t put_lockfree(pipeline_t *pl, void *const *ptrs, size_t count, const deadline_t *deadline) {
+    unsigned spins = 0;
+    size_t used = 0;
+    while (used < count && !atomic_load(&pl->closed)) {
+        size_t prior = used;
+        while (used < count && give_item(pl, ptrs[used]))
+            ++used;
+        if (used > prior) {
+            wake_peer(pl, &pl->getwait, &pl->output, used - prior);
+            continue;
+        }
+        if (pl->policy == DROP) {
+            void *drop;
+            if (pl->mode == SPSC)
+                drop_spsc(pl);
+            else if (take_mpmc(pl, &drop) && drop)
+                pl->free(drop);
+            continue;
+        }
+        if (deadline && !cpr_expires(deadline, NULL)) break;
+        if (++spins < LOCKFREE_SPINS) {
+            thrd_yield();
+            continue;
+        }
+        bool waiting = true;
+        mtx_lock(&pl->lock);
+        atomic_fetch_add(&pl->putwait, 1);
+        if (atomic_load(&pl->wr) - atomic_load(&pl->rd) >= pl->size && !atomic_load(&pl->closed))
+            waiting = wait_pipeline(pl, &pl->input, deadline);
+        atomic_fetch_sub(&pl->putwait, 1);
+        mtx_unlock(&pl->lock);
+        if (!waiting) break;
+    }
+    return used;
+}
+
+static size_t get_locked(pipeline_t *pl, void **out, size_t max, const deadline_t *deadline) {
+    size_t count = 0;
+    mtx_lock(&pl->lock);
+    while (!atomic_load(&pl->closed)) {
+        if (pl->count > 0) {
+            while (count < max && pl->count) {
+                out[count++] = pl->buf[pl->head];
+                pl->buf[pl->head] = NULL;
+                pl->head = (pl->head + 1) & pl->mask;
+                --pl->count;
+            }
+            if (atomic_load(&pl->putwait)) {
+                if (count > 1)
+                    cnd_broadcast(&pl->input);
+                else
+                    cnd_signal(&pl->input);
+            }
+            break;
+        }
+        atomic_fetch_add(&pl->getwait, 1);
+        bool waiting = wait_pipeline(pl, &pl->output, deadline);
+        atomic_fetch_sub(&pl->getwait, 1);
+        if (!waiting) break;
+    }
+    mtx_unlock(&pl->lock);
+    return count;
+}
+
+static size_t put_locked(pipeline_t *pl, void *const *ptrs, size_t count, const deadline_t *deadline) {
+    size_t used = 0;
+    mtx_lock(&pl->lock);
+    while (used < count && !atomic_load(&pl->closed)) {
+        if (pl->count < pl->size) {
+            size_t prior = used;
+            while (used < count && pl->count < pl->size) {
+                pl->buf[pl->tail] = ptrs[used++];
+                pl->tail = (pl->tail + 1) & pl->mask;
+                ++pl->count;
+            }
+            if (atomic_load(&pl->getwait)) {
+                if (used - prior > 1)
+                    cnd_broadcast(&pl->output);
+                else
+                    cnd_signal(&pl->output);
+            }
+            continue;
+        }
+        if (pl->policy == DROP) {
+            void *drop = pl->buf[pl->head];
+            if (drop)
+                pl->free(drop);
+            pl->head = (pl->head + 1) & pl->mask;
+            --pl->count;
+            continue;
+        }
+        atomic_fetch_add(&pl->putwait, 1);
+        bool waiting = wait_pipeline(pl, &pl->input, deadline);
+        atomic_fetch_sub(&pl->putwait, 1);
+        if (!waiting) break;
+    }
+    mtx_unlock(&pl->lock);
+    return used;
+}
+
 void free_pipeline(pipeline_t *pl) {
     if (!pl) return;
     close_pipeline(pl);
+    void *out;
+    while (pl->mode != LOCKED && take_item(pl, &out)) {
+        if (out) pl->free(out);
+    }
+#ifndef _WIN32
+    cpr_freeevt(&pl->ready);
+#endif
     mtx_destroy(&pl->lock);
     cnd_destroy(&pl->input);
     cnd_destroy(&pl->output);
+#ifdef _WIN32
+    _aligned_free(pl);
+#else
     free(pl);
+#endif
 }
 
 void close_pipeline(pipeline_t *pl) {
     if (!pl) return;
     if (atomic_exchange(&pl->closed, true)) return;
+    mtx_lock(&pl->lock);
     cnd_broadcast(&pl->input);
     cnd_broadcast(&pl->output);
+    mtx_unlock(&pl->lock);
+#ifndef _WIN32
+    if (atomic_load(&pl->pollable) && !atomic_exchange(&pl->signaled, true))
+        cpr_setevt(&pl->ready); // so pollers see the close
+#endif
     thrd_yield();
+    if (pl->mode == MPMC) {
+        void *out;
+        while (take_mpmc(pl, &out)) {
+            if (out) pl->free(out);
+        }
+    }
+    if (pl->mode != LOCKED) return; // spsc drained when freed
     mtx_lock(&pl->lock);
     while (pl->count) {
         void *out = pl->buf[pl->head];
         if (out) pl->free(out);
-        pl->head = (pl->head + 1) % pl->size;
+        pl->head = (pl->head + 1) & pl->mask;
         --pl->count;
     }
     mtx_unlock(&pl->lock);
 }
 
-void *get_pipeline(pipeline_t *pl) {
-    if (!pl) return NULL;
+static bool ring_empty(pipeline_t *pl) {
+    if (pl->mode != LOCKED) return atomic_load(&pl->rd) == atomic_load(&pl->wr);
     mtx_lock(&pl->lock);
-    while (!atomic_load(&pl->closed)) {
-        if (pl->count > 0) {
-            void *out = pl->buf[pl->head];
-            pl->buf[pl->head] = NULL;
-            pl->head = (pl->head + 1) % pl->size;
-            if (pl->count-- == pl->size)
-                cnd_signal(&pl->input);
-            mtx_unlock(&pl->lock);
-            return out;
-        }
-        cnd_wait(&pl->output, &pl->lock);
-    }
+    bool empty = !pl->count;
     mtx_unlock(&pl->lock);
-    return NULL;
+    return empty;
+}
+
+// a snapshot, as other threads may be moving items
+static size_t ring_used(pipeline_t *pl) {
+    size_t used;
+    if (pl->mode != LOCKED) {
+        size_t rd = atomic_load(&pl->rd);
+        used = atomic_load(&pl->wr) - rd;
+    } else {
+        mtx_lock(&pl->lock);
+        used = pl->count;
+        mtx_unlock(&pl->lock);
+    }
+    return used < pl->size ? used : pl->size;
+}
+
+// producers only touch the event when the consumer has cleared it
+static void signal_ready(pipeline_t *pl) {
+#ifndef _WIN32
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(&pl->pollable, memory_order_relaxed)) return;
+    if (!atomic_exchange(&pl->signaled, true))
+        cpr_setevt(&pl->ready);
+#endif
+}
+
+#ifndef _WIN32
+// raw read, as cpr_clearevt() frees the event on any error including
+// empty, which would close the descriptor handed out by poll_pipeline()
+static bool drain_ready(pipeline_t *pl) {
+    char buf[64]; // eventfd needs 8, a pipe drains whatever is pending
+    ssize_t rtn;
+    do {
+        rtn = read(pl->ready.fds[0], buf, sizeof(buf)); // FlawFinder: ok
+    } while (rtn < 0 && errno == EINTR);
+    return rtn > 0;
+}
+#endif
+
+// drain before clearing the flag, so a racing put either writes the event
+// after the drain or is seen by the recheck of the ring. Nothing to drain
+// means the signaler has not written yet or another consumer cleared it.
+static void clear_ready(pipeline_t *pl) {
+#ifndef _WIN32
+    if (!atomic_load(&pl->pollable) || atomic_load(&pl->closed)) return;
+    if (!atomic_load(&pl->signaled) || !drain_ready(pl)) return;
+    atomic_store(&pl->signaled, false);
+    if (!ring_empty(pl)) signal_ready(pl);
+#endif
+}
+
+static size_t get_until(pipeline_t *pl, void **out, size_t max, const deadline_t *deadline) {
+    if (!pl || !out || !max) return 0;
+    size_t count;
+    if (pl->mode != LOCKED)
+        count = get_lockfree(pl, out, max, deadline);
+    else
+        count = get_locked(pl, out, max, deadline);
+    if (count < max) clear_ready(pl);
+    return count;
+}
+
+static size_t put_until(pipeline_t *pl, void *const *ptrs, size_t count, const deadline_t *deadline) {
+    if (!pl || !ptrs) return 0;
+    size_t used;
+    if (pl->mode != LOCKED)
+        used = put_lockfree(pl, ptrs, count, deadline);
+    else
+        used = put_locked(pl, ptrs, count, deadline);
+    if (used) signal_ready(pl);
+    return used;
+}
+
+size_t get_pipeline_n(pipeline_t *pl, void **out, size_t max, long timeout) {
+    deadline_t deadline;
+    if (timeout < 0) return get_until(pl, out, max, NULL);
+    if (!cpr_deadline(&deadline, timeout)) return 0;
+    return get_until(pl, out, max, &deadline);
+}
+
+size_t put_pipeline_n(pipeline_t *pl, void *const *ptrs, size_t count) {
+    return put_until(pl, ptrs, count, NULL);
+}
+
+void *get_pipeline(pipeline_t *pl) {
+    void *out = NULL;
+    if (!get_until(pl, &out, 1, NULL)) return NULL;
+    return out;
+}
+
+bool put_pipeline(pipeline_t *pl, void *ptr) {
+    return put_until(pl, &ptr, 1, NULL) == 1;
+}
+
+void *try_get_pipeline(pipeline_t *pl) {
+    return get_pipeline_until(pl, &nowait);
+}
+
+bool try_put_pipeline(pipeline_t *pl, void *ptr) {
+    return put_pipeline_until(pl, ptr, &nowait);
+}
+
+void *get_pipeline_until(pipeline_t *pl, const deadline_t *deadline) {
+    void *out = NULL;
+    if (!deadline || !get_until(pl, &out, 1, deadline)) return NULL;
+    return out;
+}
+
+bool put_pipeline_until(pipeline_t *pl, void *ptr, const deadline_t *deadline) {
+    if (!deadline) return false;
+    return put_until(pl, &ptr, 1, deadline) == 1;
 }
 
 bool is_pipeline(pipeline_t *pl) {
@@ -71,28 +477,88 @@ bool is_pipeline(pipeline_t *pl) {
     return !atomic_load(&pl->closed);
 }
 
-bool put_pipeline(pipeline_t *pl, void *ptr) {
-    if (!pl) return false;
+#ifndef _WIN32
+int poll_pipeline(pipeline_t *pl) {
+    if (!pl) return -1;
     mtx_lock(&pl->lock);
-    while (!atomic_load(&pl->closed)) {
-        if (pl->count < pl->size) {
-            pl->buf[pl->tail] = ptr;
-            pl->tail = (pl->tail + 1) % pl->size;
-            if (pl->count++ == 0)
-                cnd_signal(&pl->output);
+    if (!atomic_load(&pl->pollable)) {
+        if (!cpr_initevt(&pl->ready)) {
             mtx_unlock(&pl->lock);
-            return true;
-        }
-        if (pl->policy == WAIT)
-            cnd_wait(&pl->input, &pl->lock);
-        else {
-            void *drop = pl->buf[pl->head];
-            if (drop)
-                pl->free(drop);
-            pl->head = (pl->head + 1) % pl->size;
-            --pl->count;
+            return -1;
         }
+        atomic_store(&pl->pollable, true);
     }
     mtx_unlock(&pl->lock);
-    return false;
+    if (!ring_empty(pl) || atomic_load(&pl->closed)) signal_ready(pl);
+    return pl->ready.fds[0];
+}
+#endif
+
+bool shard_pipeline(pipeline_t **list, size_t count, size_t hash, void *ptr) {
+    if (!list || !count) return false;
+    return put_pipeline(list[hash % count], ptr);
+}
+
+// round robin, passing over full outputs before blocking on the next one.
+// Fullness is checked first, as a put to a drop output never fails.
+bool fanout_pipeline(pipeline_t **list, size_t count, atomic_size_t *next, void *ptr) {
+    if (!list || !count || !next) return false;
+    size_t start = atomic_fetch_add_explicit(next, 1, memory_order_relaxed);
+    for (size_t pos = 0; pos < count; ++pos) {
+        pipeline_t *pl = list[(start + pos) % count];
+        if (ring_used(pl) < pl->size && put_until(pl, &ptr, 1, &nowait)) return true;
+    }
+    return put_pipeline(list[start % count], ptr);
+}
+
+#ifndef _WIN32
+static _Thread_local size_t select_next = 0;
+
+int select_pipeline(pipeline_t **list, size_t count, void **out, long timeout) {
+    if (!list || !out || !count || count > SELECT_MAX) return -1;
+    deadline_t deadline;
+    if (timeout >= 0 && !cpr_deadline(&deadline, timeout)) return -1;
+    struct pollfd fds[SELECT_MAX];
+    for (;;) {
+        size_t open = 0, start = select_next++;
+        for (size_t pos = 0; pos < count; ++pos) {
+            size_t index = (start + pos) % count;
+            pipeline_t *pl = list[index];
+            fds[index].fd = -1;
+            fds[index].events = POLLIN;
+            fds[index].revents = 0;
+            if (!is_pipeline(pl)) continue;
+            if (get_until(pl, out, 1, &nowait)) return (int)index;
+            int fd = atomic_load(&pl->pollable) ? pl->ready.fds[0] : poll_pipeline(pl);
+            if (fd < 0) return -1; // nothing could ever wake us for it
+            fds[index].fd = fd;
+            ++open;
+        }
+        if (!open) return -1;
+        int wait = -1;
+        if (timeout >= 0) {
+            long ms = cpr_expires(&deadline, NULL);
+            if (!ms) return -1;
+            wait = (int)ms;
+        }
+        if (poll(fds, count, wait) < 0 && errno != EINTR) return -1;
+    }
+}
+
+// forward what is ready and fits, waiting only for the first item
+size_t fanin_pipeline(pipeline_t **list, size_t count, pipeline_t *out, long timeout) {
+    if (!out || !is_pipeline(out)) return 0;
+    size_t moved = 0, room = out->size - ring_used(out);
+    while (moved < room) {
+        void *ptr = NULL;
+        int index = select_pipeline(list, count, &ptr, moved ? 0 : timeout);
+        if (index < 0) break;
+        if (!put_pipeline(out, ptr)) {
+            if (ptr) list[index]->free(ptr);
+            break;
+        }
+        ++moved;
+    }
+    return moved;
 }
+#endif
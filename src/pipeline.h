@@ -6,6 +6,8 @@
 
 #include "thread.h"
 #include "memory.h"
+#include "sync.h"
+#include "events.h"
 
 #include <stdatomic.h>
 
@@ -14,18 +16,58 @@ typedef struct pipeline {
         WAIT = 0,
         DROP
     } policy;
+    enum {
+        LOCKED = 0,
+        SPSC, // one producer and one consumer thread, lock-free
+        MPMC  // any number of producers and consumers, lock-free
+    } mode;
     mtx_t lock;
     cnd_t input, output;
-    size_t head, tail, count, size;
+    size_t head, tail, count, size, mask; // size is a power of two
     atomic_bool closed;
+    atomic_uint getwait, putwait; // lock-free mode sleepers
+    atomic_size_t *seq;           // mpmc cell sequences
     cpr_free_t free;
+#ifndef _WIN32
+    event_t ready;                    // readable while items may be pending
+    atomic_bool pollable, signaled;
+#endif
+    _Alignas(CPR_CACHELINE) union { // consumer line, with its last seen producer index
+        struct {
+            atomic_size_t rd;
+            size_t wrseen;
+        };
+        uint8_t rdline[CPR_CACHELINE];
+    };
+    _Alignas(CPR_CACHELINE) union { // producer line
+        struct {
+            atomic_size_t wr;
+            size_t rdseen;
+        };
+        uint8_t wrline[CPR_CACHELINE];
+    };
     void *buf[];
 } pipeline_t;
 
 pipeline_t *make_pipeline(size_t size, int policy, cpr_free_t ff);
+pipeline_t *make_spsc_pipeline(size_t size, int policy, cpr_free_t ff);
+pipeline_t *make_mpmc_pipeline(size_t size, int policy, cpr_free_t ff);
 void close_pipeline(pipeline_t *pl);
 void free_pipeline(pipeline_t *pl);
 void *get_pipeline(pipeline_t *pl);
 bool put_pipeline(pipeline_t *pl, void *ptr);
+size_t get_pipeline_n(pipeline_t *pl, void **out, size_t max, long timeout);
+size_t put_pipeline_n(pipeline_t *pl, void *const *ptrs, size_t count);
+void *try_get_pipeline(pipeline_t *pl);
+bool try_put_pipeline(pipeline_t *pl, void *ptr);
+void *get_pipeline_until(pipeline_t *pl, const deadline_t *deadline);
+bool put_pipeline_until(pipeline_t *pl, void *ptr, const deadline_t *deadline);
 bool is_pipeline(pipeline_t *pl);
+bool shard_pipeline(pipeline_t **list, size_t count, size_t hash, void *ptr);
+bool fanout_pipeline(pipeline_t **list, size_t count, atomic_size_t *next, void *ptr);
+#ifndef _WIN32
+int poll_pipeline(pipeline_t *pl);
+int select_pipeline(pipeline_t **list, size_t count, void **out, long timeout);
+size_t fanin_pipeline(pipeline_t **list, size_t count, pipeline_t *out, long timeout);
+#endif
 #endif
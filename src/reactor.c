@@ -0,0 +1,388 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#ifndef _WIN32
+#include "reactor.h"
+#include "sync.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <poll.h>
+
+#if defined(__linux__) && !defined(CPR_REACTOR_POLL)
+#define REACTOR_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#define REACTOR_EVENTS 256 // ready events taken per wait
+
+struct cpr_source {
+    cpr_source_t *prev, *next; // all sources, to free with the reactor
+    cpr_source_t *reap;        // unwatched, freed after dispatch
+    int fd;
+    bool dead;
+    bufio_t *buf; // NULL for events
+    void *object;
+    cpr_ready_t fn;
+    void *ctx;
+    size_t index; // poll slot
+};
+
+struct cpr_timer {
+    cpr_timer_t *prev, *next; // fired one-shots, kept until cancelled
+    deadline_t deadline;
+    long repeat;
+    bool cancel, fired;
+    cpr_ready_t fn;
+    void *ctx;
+    size_t index; // heap slot, SIZE_MAX while firing or fired
+};
+
+struct cpr_reactor {
+#ifdef REACTOR_EPOLL
+    int epfd;
+#else
+    struct pollfd *fds;
+    cpr_source_t **list;
+    size_t count, size;
+#endif
+    cpr_source_t *sources, *reap;
+    cpr_timer_t *fired;
+    cpr_timer_t **heap;
+    size_t timers, slots;
+};
+
+static bool timer_before(const cpr_timer_t *t1, const cpr_timer_t *t2) {
+    if (t1->deadline.tv_sec != t2->deadline.tv_sec)
+        return t1->deadline.tv_sec < t2->deadline.tv_sec;
+    return t1->deadline.tv_nsec < t2->deadline.tv_nsec;
+}
+
+static void heap_set(cpr_reactor_t *rx, size_t pos, cpr_timer_t *timer) {
+    rx->heap[pos] = timer;
+    timer->index = pos;
+}
+
+static void sift_up(cpr_reactor_t *rx, size_t pos) {
+    cpr_timer_t *timer = rx->heap[pos];
+    while (pos) {
+        size_t parent = (pos - 1) / 2;
+        if (!timer_before(timer, rx->heap[parent])) break;
+        heap_set(rx, pos, rx->heap[parent]);
+        pos = parent;
+    }
+    heap_set(rx, pos, timer);
+}
+
+static void sift_down(cpr_reactor_t *rx, size_t pos) {
+    cpr_timer_t *timer = rx->heap[pos];
+    for (;;) {
+        size_t child = (pos * 2) + 1;
+        if (child >= rx->timers) break;
+        if (child + 1 < rx->timers && timer_before(rx->heap[child + 1], rx->heap[child]))
+            ++child;
+        if (!timer_before(rx->heap[child], timer)) break;
+        heap_set(rx, pos, rx->heap[child]);
+        pos = child;
+    }
+    heap_set(rx, pos, timer);
+}
+
+static bool heap_push(cpr_reactor_t *rx, cpr_timer_t *timer) {
+    if (rx->timers >= rx->slots) {
+        size_t slots = rx->slots ? rx->slots * 2 : 16;
+        cpr_timer_t **heap = realloc(rx->heap, slots * sizeof(cpr_timer_t *));
+        if (!heap) return false;
+        rx->heap = heap;
+        rx->slots = slots;
+    }
+    heap_set(rx, rx->timers++, timer);
+    sift_up(rx, timer->index);
+    return true;
+}
+
+static void heap_remove(cpr_reactor_t *rx, size_t pos) {
+    cpr_timer_t *timer = rx->heap[pos];
+    if (pos < --rx->timers) {
+        cpr_timer_t *moved = rx->heap[rx->timers];
+        heap_set(rx, pos, moved);
+        sift_down(rx, pos);
+        sift_up(rx, moved->index);
+    }
+    timer->index = SIZE_MAX;
+}
+
+static int timer_wait(cpr_reactor_t *rx, int timeout) {
+    if (!rx->timers) return timeout;
+    long ms = cpr_expires(&rx->heap[0]->deadline, NULL);
+    if (timeout >= 0 && timeout < ms) return timeout;
+    return ms > INT_MAX ? INT_MAX : (int)ms;
+}
+
+// so the caller's handle stays valid until it is cancelled
+static void keep_fired(cpr_reactor_t *rx, cpr_timer_t *timer) {
+    timer->fired = true;
+    timer->prev = NULL;
+    timer->next = rx->fired;
+    if (timer->next) timer->next->prev = timer;
+    rx->fired = timer;
+}
+
+static int run_timers(cpr_reactor_t *rx) {
+    int count = 0;
+    while (rx->timers && !cpr_expires(&rx->heap[0]->deadline, NULL)) {
+        cpr_timer_t *timer = rx->heap[0];
+        heap_remove(rx, 0);
+        timer->fn(timer, 0, timer->ctx);
+        ++count;
+        if (timer->repeat > 0 && !timer->cancel) {
+            cpr_adjust(&timer->deadline, timer->repeat);
+            if (!cpr_expires(&timer->deadline, NULL)) // fell behind
+                cpr_deadline(&timer->deadline, timer->repeat);
+            if (heap_push(rx, timer)) continue;
+        }
+        if (timer->cancel)
+            free(timer);
+        else
+            keep_fired(rx, timer);
+    }
+    return count;
+}
+
+static void reap_sources(cpr_reactor_t *rx) {
+    while (rx->reap) {
+        cpr_source_t *src = rx->reap;
+        rx->reap = src->reap;
+#ifndef REACTOR_EPOLL
+        size_t last = --rx->count;
+        if (src->index < last) {
+            rx->list[src->index] = rx->list[last];
+            rx->fds[src->index] = rx->fds[last];
+            rx->list[src->index]->index = src->index;
+        }
+#endif
+        if (src->prev)
+            src->prev->next = src->next;
+        else
+            rx->sources = src->next;
+        if (src->next) src->next->prev = src->prev;
+        free(src);
+    }
+}
+
+static cpr_source_t *add_source(cpr_reactor_t *rx, int fd, bufio_t *b, void *object, cpr_ready_t fn, void *ctx) {
+    if (!rx || fd < 0 || !fn) return NULL;
+    cpr_source_t *src = malloc(sizeof(cpr_source_t));
+    if (!src) return NULL;
+    src->reap = NULL;
+    src->fd = fd;
+    src->dead = false;
+    src->buf = b;
+    src->object = object;
+    src->fn = fn;
+    src->ctx = ctx;
+#ifdef REACTOR_EPOLL
+    // edge triggered, so interest never has to be rearmed
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | EPOLLET, .data.ptr = src};
+    if (b) ev.events |= EPOLLOUT;
+    if (epoll_ctl(rx->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        free(src);
+        return NULL;
+    }
+#else
+    if (rx->count >= rx->size) {
+        size_t size = rx->size ? rx->size * 2 : 64;
+        struct pollfd *fds = realloc(rx->fds, size * sizeof(struct pollfd));
+        if (fds) rx->fds = fds;
+        cpr_source_t **list = realloc(rx->list, size * sizeof(cpr_source_t *));
+        if (list) rx->list = list;
+        if (!fds || !list) {
+            free(src);
+            return NULL;
+        }
+        rx->size = size;
+    }
+    src->index = rx->count++;
+    rx->list[src->index] = src;
+    rx->fds[src->index].fd = fd;
+    rx->fds[src->index].events = POLLIN;
+    rx->fds[src->index].revents = 0;
+#endif
+    src->prev = NULL;
+    src->next = rx->sources;
+    if (src->next) src->next->prev = src;
+    rx->sources = src;
+    return src;
+}
+
+cpr_reactor_t *cpr_makereactor(void) {
+    cpr_reactor_t *rx = malloc(sizeof(cpr_reactor_t));
+    if (!rx) return NULL;
+#ifdef REACTOR_EPOLL
+    rx->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (rx->epfd < 0) {
+        free(rx);
+        return NULL;
+    }
+#else
+    rx->fds = NULL;
+    rx->list = NULL;
+    rx->count = rx->size = 0;
+#endif
+    rx->sources = rx->reap = NULL;
+    rx->fired = NULL;
+    rx->heap = NULL;
+    rx->timers = rx->slots = 0;
+    return rx;
+}
+
+// watched objects are not closed, only their registrations freed
+void cpr_freereactor(cpr_reactor_t *rx) {
+    if (!rx) return;
+    while (rx->sources) {
+        cpr_source_t *src = rx->sources;
+        rx->sources = src->next;
+        free(src);
+    }
+    while (rx->timers)
+        free(rx->heap[--rx->timers]);
+    while (rx->fired) {
+        cpr_timer_t *timer = rx->fired;
+        rx->fired = timer->next;
+        free(timer);
+    }
+#ifdef REACTOR_EPOLL
+    close(rx->epfd);
+#else
+    free(rx->fds);
+    free(rx->list);
+#endif
+    free(rx->heap);
+    free(rx);
+}
+
+// use a non-blocking bufio, and read until it would block
+cpr_source_t *cpr_watchbuf(cpr_reactor_t *rx, bufio_t *b, cpr_ready_t fn, void *ctx) {
+    if (!b) return NULL;
+    return add_source(rx, b->fd, b, b, fn, ctx);
+}
+
+cpr_source_t *cpr_watchevt(cpr_reactor_t *rx, event_t *evt, cpr_ready_t fn, void *ctx) {
+    if (!evt) return NULL;
+    return add_source(rx, evt->fds[0], NULL, evt, fn, ctx);
+}
+
+bool cpr_unwatch(cpr_reactor_t *rx, cpr_source_t *src) {
+    if (!rx || !src || src->dead) return false;
+    src->dead = true;
+#ifdef REACTOR_EPOLL
+    epoll_ctl(rx->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+#else
+    rx->fds[src->index].fd = -1;
+#endif
+    src->reap = rx->reap;
+    rx->reap = src;
+    return true;
+}
+
+cpr_timer_t *cpr_addtimer(cpr_reactor_t *rx, long ms, long repeat, cpr_ready_t fn, void *ctx) {
+    if (!rx || !fn || ms < 0) return NULL;
+    cpr_timer_t *timer = malloc(sizeof(cpr_timer_t));
+    if (!timer) return NULL;
+    if (!cpr_deadline(&timer->deadline, ms)) {
+        free(timer);
+        return NULL;
+    }
+    timer->repeat = repeat;
+    timer->cancel = timer->fired = false;
+    timer->fn = fn;
+    timer->ctx = ctx;
+    if (!heap_push(rx, timer)) {
+        free(timer);
+        return NULL;
+    }
+    return timer;
+}
+
+// a timer may cancel itself from its own callback, and a fired one-shot is
+// released with false as there was nothing left to cancel
+bool cpr_canceltimer(cpr_reactor_t *rx, cpr_timer_t *timer) {
+    if (!rx || !timer || timer->cancel) return false;
+    if (timer->fired) {
+        if (timer->prev)
+            timer->prev->next = timer->next;
+        else
+            rx->fired = timer->next;
+        if (timer->next) timer->next->prev = timer->prev;
+        free(timer);
+        return false;
+    }
+    if (timer->index == SIZE_MAX) {
+        timer->cancel = true;
+        return true;
+    }
+    heap_remove(rx, timer->index);
+    free(timer);
+    return true;
+}
+
+// wait once, then dispatch ready sources and due timers
+int cpr_runreactor(cpr_reactor_t *rx, int timeout_ms) {
+    if (!rx) return -1;
+    int wait = timer_wait(rx, timeout_ms);
+    int count = 0;
+#ifdef REACTOR_EPOLL
+    struct epoll_event events[REACTOR_EVENTS];
+    int ready = epoll_wait(rx->epfd, events, REACTOR_EVENTS, wait);
+    if (ready < 0 && errno != EINTR) return -1;
+    for (int pos = 0; pos < ready; ++pos) {
+        cpr_source_t *src = events[pos].data.ptr;
+        if (src->dead) continue;
+        unsigned flags = 0;
+        if (events[pos].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+            flags |= BUFIO_READ;
+        if (events[pos].events & EPOLLOUT)
+            flags |= BUFIO_WRITE;
+        if (events[pos].events & EPOLLERR)
+            flags |= BUFIO_ERROR;
+        src->fn(src->object, flags, src->ctx);
+        ++count;
+    }
+#else
+    for (size_t pos = 0; pos < rx->count; ++pos) {
+        cpr_source_t *src = rx->list[pos];
+        short events = POLLIN;
+        if (src->buf) {
+            unsigned want = cpr_wantbuf(src->buf);
+            events = (short)(((want & BUFIO_READ) ? POLLIN : 0) | ((want & BUFIO_WRITE) ? POLLOUT : 0));
+        }
+        rx->fds[pos].events = events;
+        rx->fds[pos].revents = 0;
+    }
+    size_t active = rx->count;
+    int ready = poll(rx->fds, (nfds_t)active, wait);
+    if (ready < 0 && errno != EINTR) return -1;
+    for (size_t pos = 0; pos < active && ready > 0; ++pos) {
+        short revents = rx->fds[pos].revents;
+        if (!revents) continue;
+        --ready;
+        cpr_source_t *src = rx->list[pos];
+        if (src->dead) continue;
+        unsigned flags = 0;
+        if (revents & (POLLIN | POLLHUP))
+            flags |= BUFIO_READ;
+        if (revents & POLLOUT)
+            flags |= BUFIO_WRITE;
+        if (revents & (POLLERR | POLLNVAL))
+            flags |= BUFIO_ERROR;
+        src->fn(src->object, flags, src->ctx);
+        ++count;
+    }
+#endif
+    count += run_timers(rx);
+    reap_sources(rx);
+    return count;
+}
+#endif
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#ifndef CPR_REACTOR_H
+#define CPR_REACTOR_H
+
+#ifndef _WIN32
+#include "bufio.h"
+#include "events.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cpr_reactor cpr_reactor_t;
+typedef struct cpr_source cpr_source_t;
+typedef struct cpr_timer cpr_timer_t;
+
+// object is the bufio_t, event_t, or cpr_timer_t that became ready
+typedef void (*cpr_ready_t)(void *object, unsigned events, void *ctx);
+
+cpr_reactor_t *cpr_makereactor(void);
+void cpr_freereactor(cpr_reactor_t *rx);
+cpr_source_t *cpr_watchbuf(cpr_reactor_t *rx, bufio_t *b, cpr_ready_t fn, void *ctx);
+cpr_source_t *cpr_watchevt(cpr_reactor_t *rx, event_t *evt, cpr_ready_t fn, void *ctx);
+bool cpr_unwatch(cpr_reactor_t *rx, cpr_source_t *src);
+// a timer is owned by the reactor until cancelled, even after a one-shot
+// fires, and the handle is invalid once cancelled or the reactor is freed
+cpr_timer_t *cpr_addtimer(cpr_reactor_t *rx, long ms, long repeat, cpr_ready_t fn, void *ctx);
+bool cpr_canceltimer(cpr_reactor_t *rx, cpr_timer_t *timer);
+int cpr_runreactor(cpr_reactor_t *rx, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+#endif
@@ -240,6 +240,21 @@ char *cpr_strchop(char *str, const char *list, size_t max) {
     return str;
 }
 
+// libc memchr is vectorized, so find the first byte and then verify
+// an empty delimiter matches at once, as the byte scanners it replaced did
+const char *cpr_memdelim(const char *data, size_t size, const char *delim, size_t len) {
+    if (!data || !delim || size < len) return NULL;
+    if (!len) return data;
+    const char *end = data + size - len + 1; // past the last possible match
+    while (data < end) {
+        const char *cp = memchr(data, delim[0], (size_t)(end - data));
+        if (!cp) return NULL;
+        if (!memcmp(cp, delim, len)) return cp;
+        data = cp + 1;
+    }
+    return NULL;
+}
+
 bool is_empty(const char *str) {
     if (!str || !*str)
         return true;
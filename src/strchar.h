@@ -32,6 +32,7 @@ char *cpr_reverse(char *str);
 char *cpr_strlong(long v, char *p, size_t s);
 char *cpr_strtrim(char *str, const char *list, size_t max);
 char *cpr_strchop(char *str, const char *list, size_t max);
+const char *cpr_memdelim(const char *data, size_t size, const char *delim, size_t len);
 bool is_empty(const char *str);
 
 inline static bool eq(const char *s1, const char *s2) {
@@ -3,6 +3,173 @@
 
 #include "thread.h"
 
+#include <unistd.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef __linux__
+#define CONDLOCK_WRITER (1U << 31)
+#define FUTEX_SLEEPERS (1U << 31) // semaphore and waitgroup sleepers
+
+static void futex_wait(atomic_uint *addr, unsigned expect) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expect, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint *addr, int count) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// waiters snapshot seq before checking, wakers bump it only for sleepers
+static void condlock_wake(cpr_condlock_t *lock) {
+    if (!atomic_load(&lock->waiting)) return;
+    atomic_fetch_add(&lock->seq, 1);
+    futex_wake(&lock->seq, INT32_MAX);
+}
+
+void cor_condlock_init(cpr_condlock_t *lock) {
+    if (!lock) return;
+    atomic_init(&lock->state, 0);
+    atomic_init(&lock->pending, 0);
+    atomic_init(&lock->waiting, 0);
+    atomic_init(&lock->seq, 0);
+}
+
+void cor_condlock_free(cpr_condlock_t *lock) {
+    (void)lock;
+}
+
+void cor_condlock_access(cpr_condlock_t *lock) {
+    if (!lock) return;
+    for (;;) {
+        unsigned seq = atomic_load(&lock->seq);
+        unsigned state = atomic_load(&lock->state);
+        if (!(state & CONDLOCK_WRITER) && !atomic_load(&lock->pending)) {
+            if (atomic_compare_exchange_weak(&lock->state, &state, state + 1)) return;
+            continue;
+        }
+        atomic_fetch_add(&lock->waiting, 1);
+        if ((atomic_load(&lock->state) & CONDLOCK_WRITER) || atomic_load(&lock->pending))
+            futex_wait(&lock->seq, seq);
+        atomic_fetch_sub(&lock->waiting, 1);
+    }
+}
+
+void cpr_condlock_release(cpr_condlock_t *lock) {
+    if (!lock) return;
+    unsigned state = atomic_load(&lock->state);
+    do {
+        if (!state || (state & CONDLOCK_WRITER)) return;
+    } while (!atomic_compare_exchange_weak(&lock->state, &state, state - 1));
+    if (state == 1) condlock_wake(lock);
+}
+
+void cpr_condlock_modify(cpr_condlock_t *lock) {
+    if (!lock) return;
+    atomic_fetch_add(&lock->pending, 1);
+    for (;;) {
+        unsigned seq = atomic_load(&lock->seq);
+        unsigned state = 0;
+        if (atomic_compare_exchange_strong(&lock->state, &state, CONDLOCK_WRITER)) break;
+        atomic_fetch_add(&lock->waiting, 1);
+        if (atomic_load(&lock->state))
+            futex_wait(&lock->seq, seq);
+        atomic_fetch_sub(&lock->waiting, 1);
+    }
+    atomic_fetch_sub(&lock->pending, 1);
+}
+
+void cpr_condlock_commit(cpr_condlock_t *lock) {
+    if (!lock) return;
+    atomic_store(&lock->state, 0);
+    condlock_wake(lock);
+}
+
+void cpr_semaphore_init(cpr_semaphore_t *sem, unsigned limit) {
+    if (!sem) return;
+    sem->count = limit;
+    atomic_init(&sem->used, 0);
+}
+
+void cpr_semaphore_free(cpr_semaphore_t *sem) {
+    (void)sem;
+}
+
+void cpr_semaphore_acquire(cpr_semaphore_t *sem) {
+    if (!sem) return;
+    unsigned used = atomic_load(&sem->used);
+    for (;;) {
+        if ((used & ~FUTEX_SLEEPERS) < sem->count) {
+            if (atomic_compare_exchange_weak(&sem->used, &used, used + 1)) return;
+            continue;
+        }
+        if (!(used & FUTEX_SLEEPERS)) {
+            if (!atomic_compare_exchange_weak(&sem->used, &used, used | FUTEX_SLEEPERS)) continue;
+            used |= FUTEX_SLEEPERS;
+        }
+        futex_wait(&sem->used, used);
+        used = atomic_load(&sem->used);
+    }
+}
+
+// the sem may be gone once released, so only the exchanged value is used
+void cpr_semaphore_release(cpr_semaphore_t *sem) {
+    if (!sem) return;
+    unsigned used = atomic_load(&sem->used);
+    do {
+        if (!(used & ~FUTEX_SLEEPERS)) return;
+    } while (!atomic_compare_exchange_weak(&sem->used, &used, (used - 1) & ~FUTEX_SLEEPERS));
+    if (used & FUTEX_SLEEPERS) futex_wake(&sem->used, INT32_MAX); // losers re-mark
+}
+
+void cpr_waitgroup_init(cpr_waitgroup_t *wg, unsigned count) {
+    if (!wg) return;
+    atomic_init(&wg->count, count);
+}
+
+void cpr_waitgroup_free(cpr_waitgroup_t *wg) {
+    (void)wg;
+}
+
+void cpr_waitgroup_add(cpr_waitgroup_t *wg, unsigned count) {
+    if (!wg) return;
+    atomic_fetch_add(&wg->count, count);
+}
+
+void cpr_waitgroup_wait(cpr_waitgroup_t *wg) {
+    if (!wg) return;
+    unsigned count = atomic_load(&wg->count);
+    while (count & ~FUTEX_SLEEPERS) {
+        if (!(count & FUTEX_SLEEPERS)) {
+            if (!atomic_compare_exchange_weak(&wg->count, &count, count | FUTEX_SLEEPERS)) continue;
+            count |= FUTEX_SLEEPERS;
+        }
+        futex_wait(&wg->count, count);
+        count = atomic_load(&wg->count);
+    }
+}
+
+// the waiter may free wg as soon as it sees zero, so only the
+// exchanged value decides the wake
+void cpr_waitgroup_done(cpr_waitgroup_t *wg) {
+    if (!wg) return;
+    unsigned count = atomic_load(&wg->count), next;
+    do {
+        if (!(count & ~FUTEX_SLEEPERS)) return;
+        next = count - 1;
+        if (!(next & ~FUTEX_SLEEPERS)) next = 0;
+    } while (!atomic_compare_exchange_weak(&wg->count, &count, next));
+    if (!next && (count & FUTEX_SLEEPERS))
+        futex_wake(&wg->count, INT32_MAX);
+}
+
+static unsigned waitgroup_pending(cpr_waitgroup_t *wg) {
+    return atomic_load(&wg->count) & ~FUTEX_SLEEPERS;
+}
+#else
 void cor_condlock_init(cpr_condlock_t *lock) {
     if (!lock) return;
     lock->pending = lock->waiting = lock->sharing = 0;
@@ -132,7 +299,495 @@ void cpr_waitgroup_done(cpr_waitgroup_t *wg) {
     mtx_unlock(&wg->mtx);
 }
 
+static unsigned waitgroup_pending(cpr_waitgroup_t *wg) {
+    mtx_lock(&wg->mtx);
+    unsigned count = wg->count;
+    mtx_unlock(&wg->mtx);
+    return count;
+}
+#endif
+
 void cpr_waitgroup_finish(cpr_waitgroup_t *wg) {
     cpr_waitgroup_wait(wg);
     cpr_waitgroup_free(wg);
 }
+
+void cpr_adaptive_init(cpr_adaptive_t *mtx, unsigned spins) {
+    if (!mtx) return;
+    atomic_init(&mtx->state, 0);
+    atomic_init(&mtx->average, 0);
+    mtx->spins = spins ? spins : CPR_ADAPTIVE_SPINS;
+}
+
+bool cpr_adaptive_trylock(cpr_adaptive_t *mtx) {
+    unsigned state = 0;
+    return mtx && atomic_compare_exchange_strong_explicit(&mtx->state, &state, 1, memory_order_acquire, memory_order_relaxed);
+}
+
+// spin about twice as long as recent acquires took, then park
+void cpr_adaptive_lock(cpr_adaptive_t *mtx) {
+    if (!mtx || cpr_adaptive_trylock(mtx)) return;
+    unsigned average = atomic_load_explicit(&mtx->average, memory_order_relaxed);
+    unsigned limit = average * 2 + 10;
+    if (limit > mtx->spins) limit = mtx->spins;
+    for (unsigned count = 1; count <= limit; ++count) {
+        cpr_relax();
+        if (atomic_load_explicit(&mtx->state, memory_order_relaxed) == 0 && cpr_adaptive_trylock(mtx)) {
+            atomic_store_explicit(&mtx->average, average + ((int)(count - average) / 8), memory_order_relaxed);
+            return;
+        }
+    }
+    atomic_store_explicit(&mtx->average, average + ((int)(limit - average) / 8), memory_order_relaxed);
+    while (atomic_exchange_explicit(&mtx->state, 2, memory_order_acquire) != 0) {
+#ifdef __linux__
+        futex_wait(&mtx->state, 2);
+#else
+        thrd_yield();
+#endif
+    }
+}
+
+void cpr_adaptive_unlock(cpr_adaptive_t *mtx) {
+    if (!mtx) return;
+    if (atomic_exchange_explicit(&mtx->state, 0, memory_order_release) == 2) {
+#ifdef __linux__
+        futex_wake(&mtx->state, 1);
+#endif
+    }
+}
+
+void cpr_ticket_init(cpr_ticket_t *lock) {
+    if (!lock) return;
+    atomic_init(&lock->next, 0);
+    atomic_init(&lock->serving, 0);
+}
+
+// backoff is proportional to our place in line, yields if the holder stalls
+void cpr_ticket_lock(cpr_ticket_t *lock) {
+    if (!lock) return;
+    unsigned ticket = atomic_fetch_add_explicit(&lock->next, 1, memory_order_relaxed);
+    unsigned rounds = 0;
+    for (;;) {
+        unsigned ahead = ticket - atomic_load_explicit(&lock->serving, memory_order_acquire);
+        if (!ahead) return;
+        if (ahead > 4 || ++rounds > 64) {
+            thrd_yield();
+            continue;
+        }
+        for (unsigned count = ahead * 32; count; --count)
+            cpr_relax();
+    }
+}
+
+void cpr_ticket_unlock(cpr_ticket_t *lock) {
+    if (!lock) return;
+    atomic_fetch_add_explicit(&lock->serving, 1, memory_order_release);
+}
+
+#define DEQUE_SLOTS 256 // initial deque ring, doubled when full
+#define PARTIAL_LINE 64 // reduce partials are padded to this stride
+
+struct cpr_job {
+    cpr_job_t *next;
+    cpr_task_t task;
+    void *arg;
+    cpr_waitgroup_t *wg;
+};
+
+typedef struct ring {
+    struct ring *prev; // retired rings kept until the pool is freed
+    size_t mask;
+    _Atomic(cpr_job_t *) slots[];
+} ring_t;
+
+// chase-lev deque, top is advanced by thieves and bottom by the owner
+struct cpr_worker {
+    union {
+        atomic_size_t top;
+        uint8_t topline[64];
+    };
+    union {
+        struct {
+            atomic_size_t bottom;
+            _Atomic(ring_t *) ring;
+            cpr_threadpool_t *pool;
+            thrd_t thread;
+            unsigned seed;
+        };
+        uint8_t line[64];
+    };
+};
+
+static _Thread_local cpr_worker_t *current = NULL;
+
+static ring_t *make_ring(size_t size) {
+    ring_t *ring = malloc(sizeof(ring_t) + (size * sizeof(cpr_job_t *)));
+    if (!ring) return NULL;
+    ring->prev = NULL;
+    ring->mask = size - 1;
+    for (size_t pos = 0; pos < size; ++pos)
+        atomic_init(&ring->slots[pos], NULL);
+    return ring;
+}
+
+static bool push_job(cpr_worker_t *worker, cpr_job_t *job) {
+    size_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    size_t top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    ring_t *ring = atomic_load_explicit(&worker->ring, memory_order_relaxed);
+    if (bottom - top > ring->mask) {
+        ring_t *grow = make_ring((ring->mask + 1) * 2);
+        if (!grow) return false;
+        for (size_t pos = top; pos != bottom; ++pos)
+            atomic_store_explicit(&grow->slots[pos & grow->mask], atomic_load_explicit(&ring->slots[pos & ring->mask], memory_order_relaxed), memory_order_relaxed);
+        grow->prev = ring;
+        atomic_store_explicit(&worker->ring, grow, memory_order_release);
+        ring = grow;
+    }
+    atomic_store_explicit(&ring->slots[bottom & ring->mask], job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+static cpr_job_t *take_job(cpr_worker_t *worker) {
+    size_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+    ring_t *ring = atomic_load_explicit(&worker->ring, memory_order_relaxed);
+    atomic_store_explicit(&worker->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    size_t top = atomic_load_explicit(&worker->top, memory_order_relaxed);
+    cpr_job_t *job = NULL;
+    if ((intptr_t)(bottom - top) >= 0) {
+        job = atomic_load_explicit(&ring->slots[bottom & ring->mask], memory_order_relaxed);
+        if (top != bottom) return job;
+        if (!atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+            job = NULL; // lost the last one to a thief
+    }
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    return job;
+}
+
+static cpr_job_t *steal_job(cpr_worker_t *worker) {
+    size_t top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    size_t bottom = atomic_load_explicit(&worker->bottom, memory_order_acquire);
+    if ((intptr_t)(bottom - top) <= 0) return NULL;
+    ring_t *ring = atomic_load_explicit(&worker->ring, memory_order_acquire);
+    cpr_job_t *job = atomic_load_explicit(&ring->slots[top & ring->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+    return job;
+}
+
+static cpr_job_t *next_job(cpr_worker_t *worker) {
+    cpr_threadpool_t *pool = worker->pool;
+    cpr_job_t *job = take_job(worker);
+    if (job) return job;
+    if (atomic_load_explicit(&pool->injected, memory_order_relaxed)) {
+        mtx_lock(&pool->lock);
+        job = pool->head;
+        if (job) {
+            pool->head = job->next;
+            if (!pool->head) pool->tail = NULL;
+            atomic_fetch_sub(&pool->injected, 1);
+        }
+        mtx_unlock(&pool->lock);
+        if (job) return job;
+    }
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 17;
+    worker->seed ^= worker->seed << 5;
+    for (size_t pos = 0; pos < pool->count; ++pos) {
+        cpr_worker_t *victim = &pool->workers[(worker->seed + pos) % pool->count];
+        if (victim == worker) continue;
+        job = steal_job(victim);
+        if (job) return job;
+    }
+    return NULL;
+}
+
+static void wake_workers(cpr_threadpool_t *pool, size_t count) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(&pool->sleeping, memory_order_relaxed)) return;
+    mtx_lock(&pool->lock);
+    if (count > 1)
+        cnd_broadcast(&pool->wake);
+    else
+        cnd_signal(&pool->wake);
+    mtx_unlock(&pool->lock);
+}
+
+static void run_job(cpr_threadpool_t *pool, cpr_job_t *job) {
+    atomic_fetch_sub(&pool->queued, 1);
+    job->task(job->arg);
+    if (job->wg) cpr_waitgroup_done(job->wg);
+    free(job);
+}
+
+static int run_worker(void *arg) {
+    cpr_worker_t *worker = arg;
+    cpr_threadpool_t *pool = worker->pool;
+    current = worker;
+    mtx_lock(&pool->lock); // held by init until the worker count is final
+    mtx_unlock(&pool->lock);
+    for (;;) {
+        cpr_job_t *job = next_job(worker);
+        if (job) {
+            run_job(pool, job);
+            continue;
+        }
+        if (atomic_load(&pool->queued)) { // being taken or stolen elsewhere
+            thrd_yield();
+            continue;
+        }
+        mtx_lock(&pool->lock);
+        atomic_fetch_add(&pool->sleeping, 1);
+        if (!atomic_load(&pool->queued) && !atomic_load(&pool->stop))
+            cnd_wait(&pool->wake, &pool->lock);
+        atomic_fetch_sub(&pool->sleeping, 1);
+        mtx_unlock(&pool->lock);
+        if (atomic_load(&pool->stop) && !atomic_load(&pool->queued)) break;
+    }
+    current = NULL;
+    return 0;
+}
+
+bool cpr_threadpool_init(cpr_threadpool_t *pool, unsigned count) {
+    if (!pool) return false;
+    if (!count) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    pool->workers = calloc(count, sizeof(cpr_worker_t));
+    if (!pool->workers) return false;
+    pool->count = 0;
+    pool->head = pool->tail = NULL;
+    atomic_init(&pool->injected, 0);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->sleeping, 0);
+    atomic_init(&pool->stop, false);
+    mtx_init(&pool->lock, mtx_plain);
+    cnd_init(&pool->wake);
+    size_t rings = 0, started = 0;
+    while (rings < count) {
+        cpr_worker_t *worker = &pool->workers[rings];
+        ring_t *ring = make_ring(DEQUE_SLOTS);
+        if (!ring) break;
+        atomic_init(&worker->top, 0);
+        atomic_init(&worker->bottom, 0);
+        atomic_init(&worker->ring, ring);
+        worker->pool = pool;
+        worker->seed = (unsigned)(rings + 1) * 2654435761U;
+        ++rings;
+    }
+    // workers wait on the lock, so they only ever see the final count
+    mtx_lock(&pool->lock);
+    while (started < rings && thrd_create(&pool->workers[started].thread, run_worker, &pool->workers[started]) == thrd_success)
+        ++started;
+    pool->count = started;
+    mtx_unlock(&pool->lock);
+    for (size_t id = started; id < rings; ++id)
+        free(atomic_load(&pool->workers[id].ring));
+    if (started) return true;
+    cpr_threadpool_free(pool);
+    return false;
+}
+
+// runs what is already queued, then joins the workers
+void cpr_threadpool_free(cpr_threadpool_t *pool) {
+    if (!pool || !pool->workers) return;
+    mtx_lock(&pool->lock);
+    atomic_store(&pool->stop, true);
+    cnd_broadcast(&pool->wake);
+    mtx_unlock(&pool->lock);
+    size_t count = pool->count;
+    for (size_t id = 0; id < count; ++id)
+        thrd_join(pool->workers[id].thread, NULL);
+    for (size_t id = 0; id < count; ++id) {
+        ring_t *ring = atomic_load(&pool->workers[id].ring);
+        while (ring) {
+            ring_t *prev = ring->prev;
+            free(ring);
+            ring = prev;
+        }
+    }
+    while (pool->head) { // only if no worker ever started
+        cpr_job_t *job = pool->head;
+        pool->head = job->next;
+        if (job->wg) cpr_waitgroup_done(job->wg);
+        free(job);
+    }
+    cnd_destroy(&pool->wake);
+    mtx_destroy(&pool->lock);
+    free(pool->workers);
+    pool->workers = NULL;
+    pool->count = 0;
+}
+
+bool cpr_threadpool_submit(cpr_threadpool_t *pool, cpr_task_t task, void *arg, cpr_waitgroup_t *wg) {
+    return cpr_threadpool_batch(pool, task, &arg, 1, wg) == 1;
+}
+
+// from a worker jobs go on its own deque, otherwise one locked append. Once
+// free has begun only workers may add, so running tasks can still split.
+size_t cpr_threadpool_batch(cpr_threadpool_t *pool, cpr_task_t task, void **args, size_t count, cpr_waitgroup_t *wg) {
+    if (!pool || !pool->count || !task || !args) return 0;
+    cpr_worker_t *worker = (current && current->pool == pool) ? current : NULL;
+    if (!worker && atomic_load(&pool->stop)) return 0;
+    cpr_job_t *head = NULL, *tail = NULL;
+    size_t used = 0;
+    if (wg) cpr_waitgroup_add(wg, (unsigned)count);
+    while (used < count) {
+        cpr_job_t *job = malloc(sizeof(cpr_job_t));
+        if (!job) break;
+        job->next = NULL;
+        job->task = task;
+        job->arg = args[used];
+        job->wg = wg;
+        if (worker) {
+            if (!push_job(worker, job)) {
+                free(job);
+                break;
+            }
+            atomic_fetch_add(&pool->queued, 1);
+        } else if (tail) {
+            tail->next = job;
+            tail = job;
+        } else
+            head = tail = job;
+        ++used;
+    }
+    if (head) {
+        mtx_lock(&pool->lock);
+        if (pool->tail)
+            pool->tail->next = head;
+        else
+            pool->head = head;
+        pool->tail = tail;
+        atomic_fetch_add(&pool->injected, used);
+        atomic_fetch_add(&pool->queued, used);
+        mtx_unlock(&pool->lock);
+    }
+    for (size_t unused = used; wg && unused < count; ++unused)
+        cpr_waitgroup_done(wg);
+    if (used) wake_workers(pool, used);
+    return used;
+}
+
+typedef struct {
+    size_t from, to;
+    void *partial;
+    cpr_range_t range;
+    cpr_partial_t reduce;
+    void *ctx;
+} chunk_t;
+
+static cpr_threadpool_t shared_pool;
+static once_flag shared_once = ONCE_FLAG_INIT;
+
+static void shared_init(void) {
+    cpr_threadpool_init(&shared_pool, 0);
+}
+
+static cpr_threadpool_t *get_pool(cpr_threadpool_t *pool) {
+    if (pool) return pool;
+    call_once(&shared_once, shared_init);
+    return shared_pool.count ? &shared_pool : NULL;
+}
+
+static void run_chunk(void *arg) {
+    chunk_t *chunk = arg;
+    if (chunk->reduce)
+        chunk->reduce(chunk->from, chunk->to, chunk->partial, chunk->ctx);
+    else
+        chunk->range(chunk->from, chunk->to, chunk->ctx);
+}
+
+// a worker that waits on its own chunks runs pool work meanwhile
+static void join_chunks(cpr_threadpool_t *pool, cpr_waitgroup_t *wg) {
+    cpr_worker_t *worker = (current && current->pool == pool) ? current : NULL;
+    while (worker) {
+        if (!waitgroup_pending(wg)) return;
+        cpr_job_t *job = next_job(worker);
+        if (job)
+            run_job(pool, job);
+        else
+            thrd_yield();
+    }
+    cpr_waitgroup_wait(wg);
+}
+
+// split into grain sized chunks, running the first in the caller
+static bool run_chunks(cpr_threadpool_t *pool, chunk_t *chunks, size_t count) {
+    cpr_waitgroup_t wg;
+    void **args = malloc(count * sizeof(void *));
+    if (!args) return false;
+    for (size_t pos = 0; pos < count; ++pos)
+        args[pos] = &chunks[pos];
+    cpr_waitgroup_init(&wg, 0);
+    size_t used = 1;
+    if (count > 1)
+        used += cpr_threadpool_batch(pool, run_chunk, args + 1, count - 1, &wg);
+    run_chunk(&chunks[0]);
+    while (used < count) // if the pool could not take them all
+        run_chunk(&chunks[used++]);
+    join_chunks(pool, &wg);
+    cpr_waitgroup_free(&wg);
+    free(args);
+    return true;
+}
+
+static size_t chunk_count(cpr_threadpool_t *pool, size_t count, size_t *grain) {
+    if (!*grain) *grain = count / (pool->count * 4) + 1;
+    return (count + *grain - 1) / *grain;
+}
+
+bool cpr_parallel_for(cpr_threadpool_t *pool, size_t count, size_t grain, cpr_range_t fn, void *ctx) {
+    pool = get_pool(pool);
+    if (!pool || !fn) return false;
+    if (!count) return true;
+    size_t chunks = chunk_count(pool, count, &grain);
+    chunk_t *list = malloc(chunks * sizeof(chunk_t));
+    if (!list) return false;
+    for (size_t pos = 0; pos < chunks; ++pos) {
+        list[pos].from = pos * grain;
+        list[pos].to = (pos + 1 == chunks) ? count : (pos + 1) * grain;
+        list[pos].partial = NULL;
+        list[pos].range = fn;
+        list[pos].reduce = NULL;
+        list[pos].ctx = ctx;
+    }
+    bool result = run_chunks(pool, list, chunks);
+    free(list);
+    return result;
+}
+
+// result holds the identity value on entry, partials are combined in order
+bool cpr_parallel_reduce(cpr_threadpool_t *pool, size_t count, size_t grain, cpr_partial_t fn, cpr_combine_t combine, void *result, size_t size, void *ctx) {
+    pool = get_pool(pool);
+    if (!pool || !fn || !combine || !result || !size) return false;
+    if (!count) return true;
+    size_t chunks = chunk_count(pool, count, &grain);
+    size_t stride = (size + PARTIAL_LINE - 1) & ~(size_t)(PARTIAL_LINE - 1);
+    chunk_t *list = malloc((chunks * (sizeof(chunk_t) + stride)) + PARTIAL_LINE - 1);
+    if (!list) return false;
+    // each partial on its own lines, so chunks never share one
+    uintptr_t addr = (uintptr_t)&list[chunks];
+    uint8_t *partials = (uint8_t *)((addr + PARTIAL_LINE - 1) & ~(uintptr_t)(PARTIAL_LINE - 1));
+    for (size_t pos = 0; pos < chunks; ++pos) {
+        list[pos].from = pos * grain;
+        list[pos].to = (pos + 1 == chunks) ? count : (pos + 1) * grain;
+        list[pos].partial = partials + (pos * stride);
+        list[pos].range = NULL;
+        list[pos].reduce = fn;
+        list[pos].ctx = ctx;
+        memcpy(list[pos].partial, result, size); // FlawFinder: ignore
+    }
+    bool done = run_chunks(pool, list, chunks);
+    if (done) {
+        memcpy(result, list[0].partial, size); // FlawFinder: ignore
+        for (size_t pos = 1; pos < chunks; ++pos)
+            combine(result, list[pos].partial, ctx);
+    }
+    free(list);
+    return done;
+}
@@ -9,11 +9,18 @@
 #include <errno.h>
 #include <sched.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 typedef pthread_t thrd_t;
 typedef int (*thrd_start_t)(void *);
 typedef pthread_mutex_t mtx_t;
 typedef pthread_cond_t cnd_t;
+typedef pthread_key_t tss_t;
+typedef void (*tss_dtor_t)(void *);
+typedef pthread_once_t once_flag;
+
+#define ONCE_FLAG_INIT PTHREAD_ONCE_INIT
 
 enum {
     thrd_success = 0,
@@ -79,6 +86,12 @@ static inline int cnd_wait(cnd_t *cond, mtx_t *mtx) {
     return pthread_cond_wait(cond, mtx) == 0 ? thrd_success : thrd_error;
 }
 
+static inline int cnd_timedwait(cnd_t *cond, mtx_t *mtx, const struct timespec *ts) {
+    int ret = pthread_cond_timedwait(cond, mtx, ts);
+    if (ret == ETIMEDOUT) return thrd_timedout;
+    return ret == 0 ? thrd_success : thrd_error;
+}
+
 static inline int cnd_signal(cnd_t *cond) {
     return pthread_cond_signal(cond) == 0 ? thrd_success : thrd_error;
 }
@@ -87,6 +100,50 @@ static inline int cnd_broadcast(cnd_t *cond) {
     return pthread_cond_broadcast(cond) == 0 ? thrd_success : thrd_error;
 }
 
+static inline void call_once(once_flag *flag, void (*func)(void)) {
+    pthread_once(flag, func);
+}
+
+static inline void cpr_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline int tss_create(tss_t *key, tss_dtor_t dtor) {
+    return pthread_key_create(key, dtor) == 0 ? thrd_success : thrd_error;
+}
+
+static inline void tss_delete(tss_t key) {
+    pthread_key_delete(key);
+}
+
+static inline void *tss_get(tss_t key) {
+    return pthread_getspecific(key);
+}
+
+static inline int tss_set(tss_t key, void *val) {
+    return pthread_setspecific(key, val) == 0 ? thrd_success : thrd_error;
+}
+
+#ifdef __linux__
+// futex based, uncontended operations take no syscall
+typedef struct {
+    atomic_uint state, pending, waiting, seq;
+} cpr_condlock_t;
+
+// high bit of used and count marks sleepers, so one rmw tells a waker
+typedef struct {
+    atomic_uint used;
+    unsigned count;
+} cpr_semaphore_t;
+
+typedef struct {
+    atomic_uint count;
+} cpr_waitgroup_t;
+#else
 typedef struct {
     mtx_t mtx;
     cnd_t bcast;
@@ -104,6 +161,37 @@ typedef struct {
     cnd_t bcast;
     unsigned count;
 } cpr_waitgroup_t;
+#endif
+
+#define CPR_ADAPTIVE_SPINS 100 // default spin limit before parking
+
+typedef struct {
+    atomic_uint state; // unlocked, locked, or locked with sleepers
+    atomic_uint average;
+    unsigned spins;
+} cpr_adaptive_t;
+
+typedef struct {
+    atomic_uint next, serving;
+} cpr_ticket_t;
+
+typedef void (*cpr_task_t)(void *arg);
+typedef void (*cpr_range_t)(size_t from, size_t to, void *ctx);
+typedef void (*cpr_partial_t)(size_t from, size_t to, void *partial, void *ctx);
+typedef void (*cpr_combine_t)(void *result, const void *partial, void *ctx);
+typedef struct cpr_worker cpr_worker_t;
+typedef struct cpr_job cpr_job_t;
+
+typedef struct {
+    cpr_worker_t *workers; // each owns a work stealing deque
+    size_t count;
+    mtx_t lock;
+    cnd_t wake;
+    cpr_job_t *head, *tail; // submitted from outside the pool
+    atomic_size_t injected, queued;
+    atomic_uint sleeping;
+    atomic_bool stop;
+} cpr_threadpool_t;
 
 void cor_condlock_init(cpr_condlock_t *lock);
 void cor_condlock_free(cpr_condlock_t *lock);
@@ -121,5 +209,18 @@ void cpr_waitgroup_add(cpr_waitgroup_t *wg, unsigned count);
 void cpr_waitgroup_wait(cpr_waitgroup_t *wg);
 void cpr_waitgroup_done(cpr_waitgroup_t *wg);
 void cpr_waitgroup_finish(cpr_waitgroup_t *wg);
+void cpr_adaptive_init(cpr_adaptive_t *mtx, unsigned spins);
+void cpr_adaptive_lock(cpr_adaptive_t *mtx);
+bool cpr_adaptive_trylock(cpr_adaptive_t *mtx);
+void cpr_adaptive_unlock(cpr_adaptive_t *mtx);
+void cpr_ticket_init(cpr_ticket_t *lock);
+void cpr_ticket_lock(cpr_ticket_t *lock);
+void cpr_ticket_unlock(cpr_ticket_t *lock);
+bool cpr_threadpool_init(cpr_threadpool_t *pool, unsigned count);
+void cpr_threadpool_free(cpr_threadpool_t *pool);
+bool cpr_threadpool_submit(cpr_threadpool_t *pool, cpr_task_t task, void *arg, cpr_waitgroup_t *wg);
+size_t cpr_threadpool_batch(cpr_threadpool_t *pool, cpr_task_t task, void **args, size_t count, cpr_waitgroup_t *wg);
+bool cpr_parallel_for(cpr_threadpool_t *pool, size_t count, size_t grain, cpr_range_t fn, void *ctx);
+bool cpr_parallel_reduce(cpr_threadpool_t *pool, size_t count, size_t grain, cpr_partial_t fn, cpr_combine_t combine, void *result, size_t size, void *ctx);
 
 #endif
@@ -20,5 +20,9 @@ int main(int argc, char **argv) {
     assert(eq(l1, "llo: world"));
     assert(eq(l2, "version: 1"));
     assert(*l3 == 0);
+
+    size_t len = 1;
+    cpr_initmem(&memio, text, strlen(text));
+    assert(cpr_lgetmem(&memio, &len, "") == text && len == 0); // empty line
 }
 
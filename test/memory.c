@@ -24,5 +24,32 @@ int main(int argc, char **argv) {
     assert(*REF(ints, int) == 7);
     RELEASE_REF(&ints);
     assert(ints == NULL);
+
+    memshare_t shared = cpr_makeref(100);
+    assert((uint8_t *)cpr_ref(shared) - (uint8_t *)shared >= CPR_CACHELINE);
+    memshare_t weak = WEAK_REF(shared);
+    assert(cpr_lock(weak) == shared);
+    assert(cpr_count(shared) == 2);
+    RELEASE_REF(&shared);
+    shared = weak;
+    RELEASE_REF(&shared);
+    assert(cpr_lock(weak) == NULL);
+    RELEASE_WEAK(&weak);
+    assert(weak == NULL);
+
+    memshare_t first = cpr_makeref(100);
+    void *reuse = first;
+    RELEASE_REF(&first);
+    first = cpr_makeref(90); // same size class comes back from the pool
+    assert((void *)first == reuse);
+    RELEASE_REF(&first);
+
+    static memshare_t many[20000]; // more than is kept pooled
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int pos = 0; pos < 20000; ++pos)
+            assert((many[pos] = cpr_makeref(100)) != NULL);
+        for (int pos = 0; pos < 20000; ++pos)
+            RELEASE_REF(&many[pos]);
+    }
 }
 
@@ -4,8 +4,256 @@
 #undef  NDEBUG
 #include <assert.h>
 #include "../src/mempager.h"
+#include "../src/thread.h"
 #include <stdio.h>
 
-int main(int argc, char **argv) {
+static void test_alloc() {
+    mempager_t pager = pager_create(256, 0);
+    assert(pager != NULL);
+    char *p1 = pager_alloc(pager, 192);
+    char *p2 = pager_alloc(pager, 200);
+    assert(p1 != NULL && p2 != NULL);
+    assert(pager->count == 2);
+    char *p3 = pager_aligned_alloc(pager, 16, 1); // fits the tail left in page one
+    assert(p3 == p1 + 192);
+    assert(pager->count == 2);
+    assert(eq(pager_strdup(pager, "hello"), "hello"));
+    assert(pager_strdup(pager, NULL) == NULL);
+    pager_free(pager);
+}
+
+static void test_large() {
+    mempager_t pager = pager_create(256, 1);
+    char *big = pager_alloc(pager, 1000);
+    assert(big != NULL && pager->count == 0);
+    memset(big, 'x', 999);
+    big[999] = 0;
+    assert(eq(pager_strdup(pager, big), big));
+    void *line = pager_aligned_alloc(pager, 4096, 64);
+    assert(line != NULL && ((uintptr_t)line % 64) == 0);
+    assert(pager_alloc(pager, 100) != NULL);
+    pager_mark_t mark = pager_mark(pager);
+    assert(pager_alloc(pager, 512) != NULL);
+    pager_rollback(pager, mark);
+    assert(pager->large == mark.large);
+    pager_reset(pager);
+    assert(pager->large == NULL);
+    pager_free(pager);
+}
+
+static void test_align() {
+    mempager_t pager = pager_create(1024, 0);
+    assert(pager != NULL);
+    char *text = pager_strdup(pager, "odd");
+    double *dp = PAGER(pager, double);
+    assert(text != NULL && dp != NULL);
+    assert(((uintptr_t)dp % _Alignof(double)) == 0);
+    void *line = pager_aligned_alloc(pager, 100, 64);
+    assert(line != NULL && ((uintptr_t)line % 64) == 0);
+    pager_strdup(pager, "x");
+    void *any = pager_alloc(pager, 8);
+    assert(((uintptr_t)any % pager->align) == 0);
+    assert(pager_aligned_alloc(pager, 8, 3) == NULL);
+    assert(pager_aligned_alloc(pager, SIZE_MAX, 1) == NULL);
+    assert(pager_aligned_alloc(pager, SIZE_MAX - 64, 64) == NULL);
+    assert(pager_align(pager, 0) == false);
+    assert(pager_align(pager, 48) == false);
+    assert(pager_align(pager, 32) == true);
+    pager_strdup(pager, "y");
+    any = pager_alloc(pager, 8);
+    assert(any != NULL && ((uintptr_t)any % 32) == 0);
+    pager_free(pager);
+}
+
+static void test_source() {
+    mempager_t pager = pager_create(4096, 0);
+    assert(pager_source(pager, PAGER_REGION) == false); // needs a limit
+#ifndef _WIN32
+    assert(pager_source(pager, PAGER_MMAP) == true);
+    assert(pager_alloc(pager, 4000) != NULL);
+    assert(pager_alloc(pager, 4000) != NULL);
+    assert(pager_source(pager, PAGER_MALLOC) == false); // pages in use
+    pager_free(pager);
+
+    pager = pager_create(4096, 4);
+    assert(pager_source(pager, PAGER_REGION) == true);
+    char *p1 = pager_alloc(pager, 4000);
+    char *p2 = pager_alloc(pager, 4000);
+    assert(p2 == p1 + 4096);
+    assert(pager_alloc(pager, 4000) != NULL);
+    assert(pager_alloc(pager, 4000) != NULL);
+    assert(pager_alloc(pager, 4000) == NULL);
+    pager_reset(pager);
+    assert(pager_alloc(pager, 4000) == p1);
+#endif
+    pager_free(pager);
+}
+
+static void test_rollback() {
+    mempager_t pager = pager_create(256, 0);
+    assert(pager_alloc(pager, 64) != NULL);
+    pager_mark_t mark = pager_mark(pager);
+    char *p1 = pager_alloc(pager, 64);
+    for (unsigned pos = 0; pos < 8; ++pos)
+        assert(pager_alloc(pager, 200) != NULL);
+    assert(pager->count == 9);
+    pager_rollback(pager, mark);
+    assert(pager->tail == pager->head);
+    assert(pager_alloc(pager, 64) == p1);
+    for (unsigned pos = 0; pos < 8; ++pos)
+        assert(pager_alloc(pager, 200) != NULL);
+    assert(pager->count == 9); // rolled back pages were reused
+
+    pager_recycle(pager);
+    assert(pager->head == NULL && pager->count == 9);
+    for (unsigned pos = 0; pos < 9; ++pos)
+        assert(pager_alloc(pager, 200) != NULL);
+    assert(pager->count == 9);
+    pager_free(pager);
+}
+
+static void test_stats() {
+    pager_stats_t stats;
+    mempager_t pager = pager_create(256, 0);
+    assert(pager_stats(pager, &stats) == false);
+    assert(pager_track(pager, true) == true);
+    assert(pager_alloc(pager, 200) != NULL);
+    assert(pager_alloc(pager, 200) != NULL);
+    assert(pager_alloc(pager, 1000) != NULL);
+    pager_recycle(pager);
+    assert(pager_alloc(pager, 100) != NULL);
+    assert(pager_stats(pager, &stats) == true);
+    assert(stats.allocs == 4 && stats.large == 1);
+    assert(stats.requested == 1500);
+    assert(stats.pages == 3 && stats.reused == 1);
+    assert(stats.highwater == 2);
+    assert(stats.wasted == 0);
+    assert(pager_alloc(pager, 200) != NULL);
+    assert(pager_stats(pager, &stats) == true);
+    assert(stats.wasted == 256 - 148);
+    pager_free(pager);
+}
+
+static int slab_worker(void *arg) {
+    void **objs = arg;
+    memslab_t slab = objs[0];
+    for (unsigned pos = 1; pos < 65; ++pos)
+        slab_release(slab, objs[pos]);
+    return 0;
 }
 
+static void test_slab() {
+    typedef struct {
+        int id;
+        char name[20];
+    } record_t;
+
+    memslab_t slab = MAKE_SLAB(record_t, 2);
+    assert(slab != NULL);
+    record_t *r1 = SLAB(slab, record_t);
+    record_t *r2 = SLAB(slab, record_t);
+    assert(r1 != NULL && r2 != NULL && r1 != r2);
+    slab_release(slab, r1);
+    assert(SLAB(slab, record_t) == r1);
+    for (unsigned pos = 2; pos < 128; ++pos)
+        assert(SLAB(slab, record_t) != NULL);
+    assert(SLAB(slab, record_t) == NULL); // two pages of 64
+    FREE_SLAB(slab);
+
+    void *objs[65];
+    slab = slab_create(sizeof(record_t), 16, 0, SLAB_CACHELINE | SLAB_SHARED);
+    objs[0] = slab;
+    for (unsigned pos = 1; pos < 65; ++pos) {
+        objs[pos] = slab_alloc(slab);
+        assert(objs[pos] != NULL && ((uintptr_t)objs[pos] % 64) == 0);
+    }
+    thrd_t thread;
+    assert(thrd_create(&thread, slab_worker, objs) == thrd_success);
+    thrd_join(thread, NULL);
+    unsigned count = slab->pager->count;
+    for (unsigned pos = 1; pos < 65; ++pos)
+        assert(slab_alloc(slab) != NULL);
+    assert(slab->pager->count == count);
+    slab_free(slab);
+}
+
+static void test_strtab() {
+    mempager_t pager = pager_create(1024, 0);
+    strtab_t tab = strtab_create(pager, 4);
+    assert(tab != NULL);
+    const char *via = strtab_intern(tab, "Via");
+    const char *from = strtab_intern(tab, "From");
+    assert(via != NULL && from != NULL && via != from);
+    assert(strtab_nintern(tab, "Via: sip", 3) == via);
+    assert(strtab_find(tab, "From") == from);
+    assert(strtab_nfind(tab, "From", 3) == NULL);
+    const char *nul = strtab_nintern(tab, "Via\0x", 5); // kept by length
+    assert(nul != NULL && nul != via);
+    assert(strtab_nfind(tab, "Via\0x", 5) == nul);
+
+    char key[16];
+    for (unsigned pos = 0; pos < 200; ++pos) {
+        snprintf(key, sizeof(key), "key%u", pos);
+        assert(strtab_intern(tab, key) != NULL);
+    }
+    assert(tab->count == 203);
+    assert(strtab_intern(tab, "Via") == via);
+    assert(eq(strtab_nfind(tab, "key77", 5), "key77"));
+    strtab_clear(tab);
+    pager_reset(pager);
+    assert(strtab_find(tab, "Via") == NULL);
+    strtab_free(tab);
+    pager_free(pager);
+}
+
+static int pool_worker(void *arg) {
+    mempager_t pager = pager_create(1024, 0);
+    if (!pager || !pager_pool(pager, (pagepool_t)arg)) return 1;
+    for (unsigned loop = 0; loop < 1000; ++loop) {
+        for (unsigned pos = 0; pos < 8; ++pos) {
+            if (!pager_alloc(pager, 900)) return 1;
+        }
+        pager_reset(pager);
+    }
+    pager_free(pager);
+    return 0;
+}
+
+static void test_pool() {
+    pagepool_t pool = pagepool_create(1024, 64, 4);
+    assert(pool != NULL);
+    mempager_t pager = pager_create(4096, 0);
+    assert(pager_pool(pager, pool) == false); // pool pages too small
+    pager_free(pager);
+
+    thrd_t workers[4];
+    for (unsigned round = 0; round < 8; ++round) { // exited caches are reused
+        for (unsigned pos = 0; pos < 4; ++pos)
+            assert(thrd_create(&workers[pos], pool_worker, pool) == thrd_success);
+        for (unsigned pos = 0; pos < 4; ++pos) {
+            int result = -1;
+            assert(thrd_join(workers[pos], &result) == thrd_success);
+            assert(result == 0);
+        }
+    }
+
+    pager = pager_create(1024, 0);
+    assert(pager_pool(pager, pool) == true);
+    for (unsigned pos = 0; pos < 64; ++pos)
+        assert(pager_alloc(pager, 900) != NULL);
+    assert(pager_alloc(pager, 900) == NULL);
+    pager_free(pager);
+    pagepool_free(pool);
+}
+
+int main(int argc, char **argv) {
+    test_alloc();
+    test_align();
+    test_large();
+    test_source();
+    test_rollback();
+    test_stats();
+    test_slab();
+    test_strtab();
+    test_pool();
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#include "../src/mempager.h"
+#include "../src/sync.h"
+#include <stdio.h>
+
+#define ALLOCS 4000000
+
+// the original allocator, which walked every page for free space
+static void *walk_alloc(mempager_t pager, size_t size) {
+    if (size + sizeof(struct _mempage) > pager->size) return NULL;
+    for (mempage_t page = pager->head; page; page = page->next) {
+        if (page->used + size <= pager->size) {
+            void *data = ((uint8_t *)page) + page->used;
+            page->used += size;
+            return data;
+        }
+    }
+    mempage_t page = pager_request(pager);
+    if (!page) return NULL;
+    page->used += size;
+    return ((uint8_t *)page) + sizeof(struct _mempage);
+}
+
+static double elapsed(const deadline_t *start) {
+    deadline_t now;
+    cpr_deadline(&now, 0);
+    return (double)(now.tv_sec - start->tv_sec) * 1e9 + (double)(now.tv_nsec - start->tv_nsec);
+}
+
+static void bench(const char *name, void *(*alloc)(mempager_t, size_t), unsigned count) {
+    mempager_t pager = pager_create(4096, 0);
+    deadline_t start;
+    cpr_deadline(&start, 0);
+    for (unsigned pos = 0; pos < count; ++pos) {
+        if (!alloc(pager, 24 + (pos % 7) * 8)) {
+            fprintf(stderr, "%s: allocation failed\n", name);
+            break;
+        }
+    }
+    double ns = elapsed(&start);
+    printf("%-8s %8u allocs %6u pages %8.1f ms %6.1f ns/alloc\n", name, count, pager->count, ns / 1e6, ns / count);
+    pager_free(pager);
+}
+
+int main(int argc, char **argv) {
+    unsigned count = ALLOCS;
+    if (argc > 1) count = (unsigned)atol(argv[1]);
+    bench("bump", pager_alloc, count);
+    bench("walk", walk_alloc, count / 20); // quadratic, so a smaller run
+    return 0;
+}
@@ -6,7 +6,213 @@
 #include "../src/bufio.h"
 #include "../src/socket.h"
 
-int main(int argc, char **argv) {
+#include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+
+static void test_vputbuf() {
+#ifndef _WIN32
+    int fds[2];
+    char body[3000], in[4096];
+    assert(pipe(fds) == 0);
+    for (size_t pos = 0; pos < sizeof(body); ++pos)
+        body[pos] = (char)('a' + (pos % 26));
+    bufio_t *w = cpr_makebuf(fds[1], 64);
+    assert(w != NULL);
+    assert(cpr_sputbuf(w, "head:") == true);
+    struct iovec iov[3] = {
+        {.iov_base = body, .iov_len = sizeof(body)},
+        {.iov_base = NULL, .iov_len = 0},
+        {.iov_base = "end", .iov_len = 3}};
+    assert(cpr_vputbuf(w, iov, 3) == sizeof(body) + 3);
+    assert(w->put == 0);
+    ssize_t len = read(fds[0], in, sizeof(in));
+    assert(len == 5 + sizeof(body) + 3);
+    assert(memcmp(in, "head:", 5) == 0);
+    assert(memcmp(in + 5, body, sizeof(body)) == 0);
+    assert(memcmp(in + 5 + sizeof(body), "end", 3) == 0);
+    cpr_freebuf(w);
+    close(fds[0]);
+#endif
+}
+
+// lines cross the end of the ring many times
+static void test_lines(bool ring) {
+#ifndef _WIN32
+    int fds[2];
+    char line[64];
+    assert(pipe(fds) == 0);
+    bufio_t *r = ring ? cpr_ringbuf(fds[0], 100) : cpr_makebuf(fds[0], 100);
+    assert(r != NULL);
+    for (int count = 0; count < 5000; ++count) {
+        int len = snprintf(line, sizeof(line), "line %d\n", count);
+        assert(write(fds[1], line, (size_t)len) == len);
+        if (count % 10 != 9) continue;
+        for (int pos = count - 9; pos <= count; ++pos) {
+            size_t size = 0;
+            const char *got = cpr_lgetbuf(r, &size, "\n");
+            snprintf(line, sizeof(line), "line %d", pos);
+            assert(got != NULL);
+            assert(size == strlen(line) && memcmp(got, line, size) == 0);
+        }
+    }
+    close(fds[1]);
+    assert(cpr_lgetbuf(r, NULL, "\n") == NULL);
+    cpr_freebuf(r);
+#endif
+}
 
+static void test_nonblock() {
+#ifndef _WIN32
+    int fds[2];
+    char block[512];
+    size_t len = 0;
+    memset(block, 'x', sizeof(block));
+    assert(pipe(fds) == 0);
+    bufio_t *r = cpr_makebuf(fds[0], 128);
+    bufio_t *w = cpr_makebuf(fds[1], 1024);
+    assert(cpr_nonblockbuf(r, true) == true);
+    assert(cpr_nonblockbuf(w, true) == true);
+    assert(cpr_lgetbuf(r, &len, "\n") == NULL);
+    assert(r->state & BUFIO_READ);
+    assert(write(fds[1], "par", 3) == 3);
+    assert(cpr_lgetbuf(r, &len, "\n") == NULL);
+    assert(r->state & BUFIO_READ);
+    assert(write(fds[1], "tial\n", 5) == 5);
+    const char *line = cpr_lgetbuf(r, &len, "\n");
+    assert(line && len == 7 && memcmp(line, "partial", 7) == 0);
+    assert(!(r->state & BUFIO_READ));
+
+    while (cpr_xputbuf(w, block, sizeof(block))) { // until the pipe is full
+    }
+    assert(cpr_wantbuf(w) & BUFIO_WRITE);
+    assert(!(w->state & BUFIO_ERROR));
+    while (cpr_wantbuf(w) & BUFIO_WRITE) {
+        while (read(fds[0], block, sizeof(block)) > 0) {
+        }
+        cpr_flushbuf(w);
+    }
+    cpr_freebuf(w);
+    cpr_freebuf(r);
+#endif
+}
+
+// each call resumes the scan where the last one would have blocked
+static void test_pieces() {
+#ifndef _WIN32
+    int fds[2];
+    size_t len = 0;
+    assert(pipe(fds) == 0);
+    bufio_t *r = cpr_makebuf(fds[0], 64);
+    assert(cpr_nonblockbuf(r, true) == true);
+    assert(write(fds[1], "ab", 2) == 2);
+    assert(cpr_lgetbuf(r, &len, "\r\n") == NULL);
+    assert(r->scan == 1);
+    assert(write(fds[1], "c\r", 2) == 2);
+    assert(cpr_lgetbuf(r, &len, "\r\n") == NULL);
+    assert(r->scan == 3);
+    assert(write(fds[1], "\nd", 2) == 2);
+    const char *line = cpr_lgetbuf(r, &len, "\r\n");
+    assert(line && len == 3 && memcmp(line, "abc", 3) == 0);
+    assert(r->scan == 0);
+    assert(cpr_lgetbuf(r, &len, "\r\n") == NULL);
+    cpr_freebuf(r);
+    close(fds[1]);
+#endif
+}
+
+// a receive timeout on a blocking stream is neither would block nor error
+static void test_timeout() {
+#ifndef _WIN32
+    int fds[2];
+    struct timeval tv = {.tv_sec = 0, .tv_usec = 10000};
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    assert(setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0);
+    bufio_t *r = cpr_makebuf(fds[0], 64);
+    assert(cpr_lgetbuf(r, NULL, "\n") == NULL);
+    assert(!(r->state & (BUFIO_READ | BUFIO_ERROR | BUFIO_EOF)));
+    assert(write(fds[1], "late\n", 5) == 5);
+    assert(eq(cpr_lgetbuf(r, NULL, "\n"), "late"));
+    cpr_freebuf(r);
+    close(fds[1]);
+#endif
+}
+
+// a line that cannot fit fails rather than refilling a full buffer forever
+static void test_overlong(bool ring) {
+#ifndef _WIN32
+    int fds[2];
+    char line[300];
+    size_t len = 0;
+    memset(line, 'x', sizeof(line));
+    assert(pipe(fds) == 0);
+    bufio_t *r = ring ? cpr_ringbuf(fds[0], 100) : cpr_makebuf(fds[0], 100);
+    assert(cpr_nonblockbuf(r, true) == true);
+    assert(write(fds[1], line, sizeof(line)) == sizeof(line));
+    assert(write(fds[1], "\nok\n", 4) == 4);
+    assert(cpr_lgetbuf(r, &len, "\n") == NULL);
+    assert(r->state & BUFIO_OVERFLOW);
+    while (!cpr_memdelim(&r->in[r->start], r->end - r->start, "\n", 1)) {
+        assert(cpr_xgetbuf(r, r->end - r->start) != NULL); // discard
+        cpr_fillbuf(r, 0);
+    }
+    assert(cpr_lgetbuf(r, &len, "\n") != NULL && len < 100);
+    const char *next = cpr_lgetbuf(r, &len, "\n");
+    assert(next && len == 2 && memcmp(next, "ok", 2) == 0);
+    assert(!(r->state & BUFIO_OVERFLOW));
+    cpr_freebuf(r);
+    close(fds[1]);
+#endif
+}
+
+// a full pipe gives back a short count rather than blocking the caller
+static void test_vnonblock() {
+#ifndef _WIN32
+    int fds[2];
+    static char body[200000], in[4096];
+    size_t sent = 0;
+    memset(body, 'v', sizeof(body));
+    assert(pipe(fds) == 0);
+    bufio_t *w = cpr_makebuf(fds[1], 64);
+    bufio_t *r = cpr_makebuf(fds[0], 64);
+    assert(cpr_nonblockbuf(w, true) == true);
+    assert(cpr_nonblockbuf(r, true) == true);
+    assert(cpr_sputbuf(w, "head:") == true);
+    struct iovec iov = {.iov_base = body, .iov_len = sizeof(body)};
+    ssize_t result = cpr_vputbuf(w, &iov, 1);
+    assert(result > 0 && (size_t)result < sizeof(body));
+    assert(w->put == 0 && (w->state & BUFIO_WRITE));
+    assert(!(w->state & BUFIO_ERROR));
+    sent = (size_t)result;
+    while (sent < sizeof(body)) {
+        while (read(fds[0], in, sizeof(in)) > 0) {
+        }
+        iov.iov_base = body + sent;
+        iov.iov_len = sizeof(body) - sent;
+        result = cpr_vputbuf(w, &iov, 1);
+        assert(result >= 0);
+        sent += (size_t)result;
+    }
+    assert(!(w->state & BUFIO_WRITE));
+    cpr_freebuf(r);
+    signal(SIGPIPE, SIG_IGN);
+    iov.iov_base = body;
+    iov.iov_len = 1;
+    assert(cpr_vputbuf(w, &iov, 1) == -1); // broken pipe, nothing taken
+    assert(w->state & BUFIO_ERROR);
+    cpr_freebuf(w);
+#endif
+}
+
+int main(int argc, char **argv) {
+    test_vputbuf();
+    test_lines(false);
+    test_lines(true);
+    test_nonblock();
+    test_pieces();
+    test_timeout();
+    test_overlong(false);
+    test_overlong(true);
+    test_vnonblock();
 }
 
@@ -14,5 +14,16 @@ int main(int argc, char **argv) {
 
     char *untrimmed = "  hello";
     assert(eq(cpr_strtrim(untrimmed, " ", 16), "hello"));
+
+    char headers[128];
+    memset(headers, 'x', sizeof(headers));
+    memcpy(headers + 40, "\r\n", 2);
+    memcpy(headers + 90, "\r\n\r\n", 4);
+    assert(cpr_memdelim(headers, sizeof(headers), "\r\n", 2) == headers + 40);
+    assert(cpr_memdelim(headers, sizeof(headers), "\r\n\r\n", 4) == headers + 90);
+    assert(cpr_memdelim(headers, 93, "\r\n\r\n", 4) == NULL);
+    assert(cpr_memdelim(headers, sizeof(headers), "\n", 1) == headers + 41);
+    assert(cpr_memdelim(headers, sizeof(headers), "xy", 2) == NULL);
+    assert(cpr_memdelim(headers, sizeof(headers), "", 0) == headers);
 }
 
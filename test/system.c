@@ -6,6 +6,9 @@
 #include "../src/service.h"
 #include "../src/pipeline.h"
 #include "../src/events.h"
+#include "../src/reactor.h"
+
+#include <unistd.h>
 
 static void test_events() {
 #ifndef _WIN32
@@ -19,7 +22,374 @@ static void test_events() {
 #endif
 }
 
+#ifndef _WIN32
+static int lines = 0, signals = 0, ticks = 0, timeouts = 0;
+
+static void on_input(void *object, unsigned events, void *ctx) {
+    (void)events;
+    (void)ctx;
+    bufio_t *in = object;
+    size_t len;
+    while (cpr_lgetbuf(in, &len, "\n"))
+        ++lines;
+}
+
+static void on_event(void *object, unsigned events, void *ctx) {
+    (void)events;
+    (void)ctx;
+    cpr_clearevt(object);
+    ++signals;
+}
+
+static void on_tick(void *object, unsigned events, void *ctx) {
+    (void)events;
+    if (++ticks == 3) cpr_canceltimer(ctx, object);
+}
+
+static void on_timeout(void *object, unsigned events, void *ctx) {
+    (void)object;
+    (void)events;
+    (void)ctx;
+    ++timeouts;
+}
+#endif
+
+static void test_reactor() {
+#ifndef _WIN32
+    int fds[2];
+    event_t evt;
+    assert(pipe(fds) == 0);
+    assert(cpr_initevt(&evt) == true);
+    cpr_reactor_t *rx = cpr_makereactor();
+    assert(rx != NULL);
+    bufio_t *in = cpr_makebuf(fds[0], 256);
+    assert(cpr_nonblockbuf(in, true) == true);
+    cpr_source_t *src = cpr_watchbuf(rx, in, on_input, NULL);
+    assert(src != NULL);
+    assert(cpr_watchevt(rx, &evt, on_event, NULL) != NULL);
+    assert(cpr_addtimer(rx, 1, 1, on_tick, rx) != NULL);
+    cpr_timer_t *never = cpr_addtimer(rx, 10000, 0, on_timeout, NULL);
+    cpr_timer_t *once = cpr_addtimer(rx, 5, 0, on_timeout, NULL);
+    assert(once != NULL);
+    assert(write(fds[1], "one\ntwo\n", 8) == 8);
+    assert(cpr_setevt(&evt) == true);
+    for (int loop = 0; loop < 100 && (lines < 2 || !signals || ticks < 3 || !timeouts); ++loop)
+        assert(cpr_runreactor(rx, 10) >= 0);
+    assert(lines == 2 && signals == 1 && ticks == 3 && timeouts == 1);
+    assert(cpr_canceltimer(rx, never) == true);
+    assert(cpr_canceltimer(rx, once) == false); // fired, only released
+    assert(cpr_unwatch(rx, src) == true);
+    assert(write(fds[1], "three\n", 6) == 6);
+    assert(cpr_runreactor(rx, 0) == 0);
+    assert(lines == 2);
+    cpr_freereactor(rx);
+    cpr_freebuf(in);
+    cpr_freeevt(&evt);
+    close(fds[1]);
+#endif
+}
+
+static void nofree(void *ptr) {
+    (void)ptr;
+}
+
+static void test_batch(pipeline_t *pl) {
+    static int items[8];
+    void *in[8], *out[8];
+    for (int pos = 0; pos < 8; ++pos)
+        in[pos] = &items[pos];
+    assert(pl->size == 4);
+    assert((uintptr_t)&pl->rd % CPR_CACHELINE == 0);
+    assert((uintptr_t)&pl->wr % CPR_CACHELINE == 0);
+    assert(put_pipeline_n(pl, in, 3) == 3);
+    assert(get_pipeline_n(pl, out, 8, 0) == 3);
+    assert(out[0] == in[0] && out[2] == in[2]);
+    assert(get_pipeline_n(pl, out, 8, 10) == 0);
+    assert(put_pipeline_n(pl, in, 8) == 8); // drop keeps the newest
+    assert(get_pipeline_n(pl, out, 2, 0) == 2);
+    assert(out[0] == in[4] && out[1] == in[5]);
+    assert(get_pipeline(pl) == in[6]);
+    free_pipeline(pl);
+}
+
+static void test_timed(pipeline_t *pl) {
+    static int items[4];
+    deadline_t deadline;
+    assert(try_get_pipeline(pl) == NULL);
+    assert(try_put_pipeline(pl, &items[0]) == true);
+    assert(try_put_pipeline(pl, &items[1]) == (pl->size > 1));
+    assert(cpr_deadline(&deadline, 10));
+    assert(put_pipeline_until(pl, &items[2], &deadline) == false);
+    assert(cpr_expires(&deadline, NULL) == 0);
+    assert(try_get_pipeline(pl) == &items[0]);
+    if (pl->size > 1) assert(try_get_pipeline(pl) == &items[1]);
+    assert(cpr_deadline(&deadline, 10));
+    assert(get_pipeline_until(pl, &deadline) == NULL);
+    free_pipeline(pl);
+}
+
+static void test_poll(pipeline_t *pl) {
+#ifndef _WIN32
+    static int items[2];
+    assert(poll_pipeline(pl) != -1);
+    assert(cpr_waitevt(&pl->ready, 0) == false);
+    assert(put_pipeline(pl, &items[0]) == true);
+    assert(put_pipeline(pl, &items[1]) == true);
+    assert(cpr_waitevt(&pl->ready, 0) == true);
+    assert(try_get_pipeline(pl) == &items[0]);
+    assert(cpr_waitevt(&pl->ready, 0) == true);
+    assert(try_get_pipeline(pl) == &items[1]);
+    assert(try_get_pipeline(pl) == NULL);
+    assert(cpr_waitevt(&pl->ready, 0) == false);
+    int fd = pl->ready.fds[0];
+    atomic_store(&pl->signaled, true); // as if a put had not written yet
+    assert(try_get_pipeline(pl) == NULL);
+    assert(pl->ready.fds[0] == fd && atomic_load(&pl->signaled));
+    assert(cpr_setevt(&pl->ready) == true);
+    assert(try_get_pipeline(pl) == NULL);
+    assert(atomic_load(&pl->signaled) == false);
+    assert(cpr_waitevt(&pl->ready, 0) == false);
+    close_pipeline(pl);
+    assert(cpr_waitevt(&pl->ready, 0) == true);
+#endif
+    free_pipeline(pl);
+}
+
+static int produced[1000];
+
+static int produce(void *arg) {
+    pipeline_t *pl = arg;
+    for (int pos = 0; pos < 1000; ++pos)
+        assert(put_pipeline(pl, &produced[pos]) == true);
+    return 0;
+}
+
+// order holds across threads, and drop only ever loses older items
+static void test_threaded(pipeline_t *pl) {
+    thrd_t producer;
+    int last = -1, index;
+    assert(thrd_create(&producer, produce, pl) == thrd_success);
+    do {
+        int *item = get_pipeline(pl);
+        assert(item != NULL);
+        index = (int)(item - produced);
+        assert(index > last && index < 1000);
+        if (pl->policy == WAIT) assert(index == last + 1);
+        last = index;
+    } while (index < 999);
+    thrd_join(producer, NULL);
+    assert(try_get_pipeline(pl) == NULL);
+    free_pipeline(pl);
+}
+
+static int shared_items[2000];
+static atomic_uint marks[2000], started, accepted, consumed;
+
+static void mark_free(void *ptr) {
+    atomic_fetch_add(&marks[(int *)ptr - shared_items], 1);
+}
+
+static int mpmc_produce(void *arg) {
+    pipeline_t *pl = arg;
+    int base = (int)atomic_fetch_add(&started, 1) * 1000;
+    for (int pos = base; pos < base + 1000; ++pos) {
+        if (!put_pipeline(pl, &shared_items[pos])) break;
+        atomic_fetch_add(&accepted, 1);
+    }
+    return 0;
+}
+
+// each consumer sees a given producer's items in the order put
+static int mpmc_consume(void *arg) {
+    pipeline_t *pl = arg;
+    int last[2] = {-1, 999};
+    int *item;
+    while ((item = get_pipeline(pl)) != NULL) {
+        int index = (int)(item - shared_items);
+        assert(index > last[index / 1000]);
+        last[index / 1000] = index;
+        atomic_fetch_add(&marks[index], 1);
+        atomic_fetch_add(&consumed, 1);
+    }
+    return 0;
+}
+
+static void reset_marks() {
+    for (int pos = 0; pos < 2000; ++pos)
+        atomic_store(&marks[pos], 0);
+    atomic_store(&started, 0);
+    atomic_store(&accepted, 0);
+    atomic_store(&consumed, 0);
+}
+
+// every item is either consumed or dropped exactly once
+static void test_mpmc(int policy) {
+    thrd_t producers[2], consumers[2];
+    pipeline_t *pl = make_mpmc_pipeline(8, policy, mark_free);
+    reset_marks();
+    for (int pos = 0; pos < 2; ++pos)
+        assert(thrd_create(&consumers[pos], mpmc_consume, pl) == thrd_success);
+    for (int pos = 0; pos < 2; ++pos)
+        assert(thrd_create(&producers[pos], mpmc_produce, pl) == thrd_success);
+    for (int pos = 0; pos < 2; ++pos)
+        thrd_join(producers[pos], NULL);
+    assert(atomic_load(&accepted) == 2000);
+    while (policy == WAIT && atomic_load(&consumed) < 2000)
+        thrd_yield();
+    close_pipeline(pl);
+    for (int pos = 0; pos < 2; ++pos)
+        thrd_join(consumers[pos], NULL);
+    free_pipeline(pl);
+    for (int pos = 0; pos < 2000; ++pos)
+        assert(atomic_load(&marks[pos]) == 1);
+}
+
+// close releases sleeping producers and consumers and frees what is left
+static void test_mpmc_close() {
+    thrd_t threads[2];
+    pipeline_t *pl = make_mpmc_pipeline(2, WAIT, mark_free);
+    reset_marks();
+    for (int pos = 0; pos < 2; ++pos)
+        assert(thrd_create(&threads[pos], mpmc_produce, pl) == thrd_success);
+    while (atomic_load(&accepted) < 2)
+        thrd_yield();
+    close_pipeline(pl);
+    for (int pos = 0; pos < 2; ++pos)
+        thrd_join(threads[pos], NULL);
+    unsigned freed = 0;
+    for (int pos = 0; pos < 2000; ++pos)
+        freed += atomic_load(&marks[pos]);
+    assert(atomic_load(&accepted) == 2 && freed == 2);
+    assert(try_put_pipeline(pl, &shared_items[0]) == false);
+    assert(get_pipeline(pl) == NULL);
+    free_pipeline(pl);
+
+    pl = make_mpmc_pipeline(2, WAIT, mark_free);
+    for (int pos = 0; pos < 2; ++pos)
+        assert(thrd_create(&threads[pos], mpmc_consume, pl) == thrd_success);
+    close_pipeline(pl);
+    for (int pos = 0; pos < 2; ++pos)
+        thrd_join(threads[pos], NULL);
+    assert(atomic_load(&consumed) == 0);
+    free_pipeline(pl);
+}
+
+// ready must never stall while a producer races the consumer clearing it
+static void test_poller(pipeline_t *pl) {
+#ifndef _WIN32
+    thrd_t producer;
+    int count = 0;
+    assert(poll_pipeline(pl) != -1);
+    assert(thrd_create(&producer, produce, pl) == thrd_success);
+    while (count < 1000) {
+        assert(cpr_waitevt(&pl->ready, 1000) == true);
+        while (try_get_pipeline(pl) != NULL)
+            ++count;
+    }
+    thrd_join(producer, NULL);
+    assert(try_get_pipeline(pl) == NULL);
+    assert(cpr_waitevt(&pl->ready, 0) == false);
+#endif
+    free_pipeline(pl);
+}
+
+static void test_select() {
+#ifndef _WIN32
+    static int items[4];
+    void *out = NULL;
+    atomic_size_t next = 0;
+    pipeline_t *list[3] = {
+        make_pipeline(4, WAIT, nofree),
+        make_spsc_pipeline(4, WAIT, nofree),
+        make_mpmc_pipeline(4, WAIT, nofree)};
+    pipeline_t *merged = make_pipeline(8, WAIT, nofree);
+    assert(select_pipeline(list, 3, &out, 0) == -1);
+    assert(select_pipeline(list, 3, &out, 10) == -1);
+    assert(shard_pipeline(list, 3, 5, &items[0]) == true);
+    assert(select_pipeline(list, 3, &out, -1) == 2);
+    assert(out == &items[0]);
+    for (int pos = 0; pos < 3; ++pos)
+        assert(fanout_pipeline(list, 3, &next, &items[pos]) == true);
+    assert(list[0]->count == 1 && try_get_pipeline(list[0]) == &items[0]);
+    assert(put_pipeline(list[0], &items[3]) == true);
+    assert(fanin_pipeline(list, 3, merged, 0) == 3);
+    assert(merged->count == 3);
+    close_pipeline(list[0]);
+    close_pipeline(list[1]);
+    close_pipeline(list[2]);
+    assert(select_pipeline(list, 3, &out, -1) == -1);
+    for (int pos = 0; pos < 3; ++pos)
+        free_pipeline(list[pos]);
+
+    list[0] = make_pipeline(4, WAIT, nofree); // as if its event had failed
+    list[0]->ready.fds[0] = list[0]->ready.fds[1] = -1;
+    atomic_store(&list[0]->pollable, true);
+    assert(select_pipeline(list, 1, &out, -1) == -1);
+    free_pipeline(list[0]);
+    free_pipeline(merged);
+#endif
+}
+
+// a full drop output is passed over rather than losing its oldest item
+static void test_fanout() {
+    static int items[2];
+    atomic_size_t next = 0;
+    pipeline_t *list[2] = {
+        make_pipeline(1, DROP, nofree),
+        make_mpmc_pipeline(2, DROP, nofree)};
+    assert(put_pipeline(list[0], &items[0]) == true);
+    assert(fanout_pipeline(list, 2, &next, &items[1]) == true);
+    assert(try_get_pipeline(list[0]) == &items[0]);
+    assert(try_get_pipeline(list[1]) == &items[1]);
+    free_pipeline(list[0]);
+    free_pipeline(list[1]);
+}
+
+// only what fits is moved, so a partly full output never blocks
+static void test_fanin() {
+#ifndef _WIN32
+    static int items[6];
+    pipeline_t *list[2] = {
+        make_spsc_pipeline(4, WAIT, nofree),
+        make_pipeline(4, WAIT, nofree)};
+    pipeline_t *merged = make_mpmc_pipeline(4, WAIT, nofree);
+    for (int pos = 0; pos < 3; ++pos) {
+        assert(put_pipeline(merged, &items[pos]) == true);
+        assert(put_pipeline(list[pos % 2], &items[pos + 3]) == true);
+    }
+    assert(fanin_pipeline(list, 2, merged, 0) == 1);
+    assert(fanin_pipeline(list, 2, merged, 10) == 0);
+    for (int pos = 0; pos < 3; ++pos)
+        free_pipeline(pos < 2 ? list[pos] : merged);
+#endif
+}
+
+static void test_pipeline() {
+    test_select();
+    test_fanout();
+    test_fanin();
+    test_poll(make_pipeline(4, WAIT, nofree));
+    test_poll(make_spsc_pipeline(4, WAIT, nofree));
+    test_poll(make_mpmc_pipeline(4, WAIT, nofree));
+    test_poller(make_pipeline(4, WAIT, nofree));
+    test_poller(make_spsc_pipeline(4, WAIT, nofree));
+    test_poller(make_mpmc_pipeline(4, WAIT, nofree));
+    test_threaded(make_spsc_pipeline(4, WAIT, nofree));
+    test_threaded(make_spsc_pipeline(4, DROP, nofree));
+    test_mpmc(WAIT);
+    test_mpmc(DROP);
+    test_mpmc_close();
+    test_timed(make_pipeline(1, WAIT, nofree));
+    test_timed(make_spsc_pipeline(1, WAIT, nofree));
+    test_timed(make_mpmc_pipeline(1, WAIT, nofree));
+    test_batch(make_pipeline(3, DROP, nofree));
+    test_batch(make_spsc_pipeline(4, DROP, nofree));
+    test_batch(make_mpmc_pipeline(3, DROP, nofree));
+}
+
 int main(int argc, char **argv) {
     test_events();
+    test_reactor();
+    test_pipeline();
 }
 
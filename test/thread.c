@@ -11,8 +11,161 @@ static void test_mutex() {
     mtx_destroy(&mutex);
 }
 
+static cpr_semaphore_t sem;
+static cpr_condlock_t lock;
+static atomic_uint inside = 0, peak = 0;
+static unsigned counter = 0;
+
+static int lock_worker(void *arg) {
+    (void)arg;
+    for (int pos = 0; pos < 10000; ++pos) {
+        cpr_semaphore_acquire(&sem);
+        unsigned now = atomic_fetch_add(&inside, 1) + 1;
+        if (now > atomic_load(&peak)) atomic_store(&peak, now);
+        atomic_fetch_sub(&inside, 1);
+        cpr_semaphore_release(&sem);
+        if (pos % 4) {
+            cor_condlock_access(&lock);
+            assert(counter <= 40000);
+            cpr_condlock_release(&lock);
+        } else {
+            cpr_condlock_modify(&lock);
+            ++counter;
+            cpr_condlock_commit(&lock);
+        }
+    }
+    return 0;
+}
+
+static void test_locks() {
+    thrd_t threads[4];
+    cpr_semaphore_init(&sem, 2);
+    cor_condlock_init(&lock);
+    for (int pos = 0; pos < 4; ++pos)
+        thrd_create(&threads[pos], lock_worker, NULL);
+    for (int pos = 0; pos < 4; ++pos)
+        thrd_join(threads[pos], NULL);
+    assert(atomic_load(&peak) <= 2);
+    assert(counter == 10000);
+    cor_condlock_free(&lock);
+    cpr_semaphore_free(&sem);
+}
+
+static cpr_adaptive_t adaptive;
+static cpr_ticket_t ticket;
+static unsigned adaptive_count = 0, ticket_count = 0;
+
+static int spin_worker(void *arg) {
+    (void)arg;
+    for (int pos = 0; pos < 20000; ++pos) {
+        cpr_adaptive_lock(&adaptive);
+        ++adaptive_count;
+        cpr_adaptive_unlock(&adaptive);
+        cpr_ticket_lock(&ticket);
+        ++ticket_count;
+        cpr_ticket_unlock(&ticket);
+    }
+    return 0;
+}
+
+static void test_spinlocks() {
+    thrd_t threads[4];
+    cpr_adaptive_init(&adaptive, 0);
+    cpr_ticket_init(&ticket);
+    assert(cpr_adaptive_trylock(&adaptive) == true);
+    assert(cpr_adaptive_trylock(&adaptive) == false);
+    cpr_adaptive_unlock(&adaptive);
+    for (int pos = 0; pos < 4; ++pos)
+        thrd_create(&threads[pos], spin_worker, NULL);
+    for (int pos = 0; pos < 4; ++pos)
+        thrd_join(threads[pos], NULL);
+    assert(adaptive_count == 80000);
+    assert(ticket_count == 80000);
+}
+
+static cpr_threadpool_t pool;
+static cpr_waitgroup_t group;
+static atomic_size_t total = 0;
+
+static void add_task(void *arg) {
+    atomic_fetch_add(&total, (uintptr_t)arg);
+}
+
+// tasks that submit more tasks land on the worker's own deque
+static void split_task(void *arg) {
+    uintptr_t value = (uintptr_t)arg;
+    if (value < 2) {
+        add_task(arg);
+        return;
+    }
+    void *args[2] = {(void *)(value / 2), (void *)(value - value / 2)};
+    assert(cpr_threadpool_batch(&pool, split_task, args, 2, &group) == 2);
+}
+
+static void test_threadpool() {
+    void *args[100];
+    for (uintptr_t pos = 0; pos < 100; ++pos)
+        args[pos] = (void *)(pos + 1);
+    assert(cpr_threadpool_init(&pool, 4) == true);
+    cpr_waitgroup_init(&group, 0);
+    assert(cpr_threadpool_batch(&pool, add_task, args, 100, &group) == 100);
+    cpr_waitgroup_wait(&group);
+    assert(atomic_load(&total) == 5050);
+    assert(cpr_threadpool_submit(&pool, split_task, (void *)100000, &group) == true);
+    cpr_waitgroup_wait(&group);
+    assert(atomic_load(&total) == 105050);
+    assert(cpr_threadpool_submit(&pool, split_task, (void *)1000, &group) == true);
+    cpr_threadpool_free(&pool); // subtasks split while freeing still run
+    assert(atomic_load(&total) == 106050);
+    cpr_waitgroup_wait(&group);
+    cpr_waitgroup_free(&group);
+}
+
+static void square_range(size_t from, size_t to, void *ctx) {
+    uint64_t *values = ctx;
+    for (size_t pos = from; pos < to; ++pos)
+        values[pos] = (uint64_t)pos * pos;
+}
+
+static void sum_range(size_t from, size_t to, void *partial, void *ctx) {
+    const uint64_t *values = ctx;
+    for (size_t pos = from; pos < to; ++pos)
+        *(uint64_t *)partial += values[pos];
+}
+
+static void sum_combine(void *result, const void *partial, void *ctx) {
+    (void)ctx;
+    *(uint64_t *)result += *(const uint64_t *)partial;
+}
+
+static void nested_for(void *arg) {
+    assert(cpr_parallel_for(&pool, 1000, 10, square_range, arg) == true);
+}
+
+static void test_parallel() {
+    static uint64_t values[10000];
+    uint64_t sum = 0, expect = 0;
+    for (uint64_t pos = 0; pos < 10000; ++pos)
+        expect += pos * pos;
+    assert(cpr_parallel_for(NULL, 10000, 0, square_range, values) == true);
+    assert(cpr_parallel_reduce(NULL, 10000, 100, sum_range, sum_combine, &sum, sizeof(sum), values) == true);
+    assert(sum == expect);
+    values[999] = 0;
+    assert(cpr_threadpool_init(&pool, 2) == true);
+    cpr_waitgroup_init(&group, 0);
+    cpr_threadpool_submit(&pool, nested_for, values, &group);
+    cpr_waitgroup_wait(&group);
+    assert(values[999] == 999 * 999);
+    cpr_waitgroup_free(&group);
+    cpr_threadpool_free(&pool);
+}
+
 int main(int argc, char **argv) {
     test_mutex();
+    test_locks();
+    test_spinlocks();
+    test_threadpool();
+    test_parallel();
     return 0;
 }
 